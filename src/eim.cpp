@@ -6,16 +6,21 @@
  *
  */
 #include "eim.h"
+#include "probe.h"
+#include <algorithm>
 #include <array>
 #include <chewing.h>
+#include <chrono>
 #include <cstdarg>
 #include <cstdio>
 #include <fcitx-config/iniparser.h>
 #include <fcitx-utils/capabilityflags.h>
+#include <fcitx-utils/event.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/keysym.h>
 #include <fcitx-utils/log.h>
 #include <fcitx-utils/standardpaths.h>
+#include <fcitx-utils/stringutils.h>
 #include <fcitx-utils/textformatflags.h>
 #include <fcitx-utils/utf8.h>
 #include <fcitx/addoninstance.h>
@@ -33,17 +38,93 @@
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
 #include <utility>
 #include <vector>
 
 FCITX_DEFINE_LOG_CATEGORY(chewing_log, "chewing");
 #define CHEWING_DEBUG() FCITX_LOGC(chewing_log, Debug)
+#define CHEWING_WARN() FCITX_LOGC(chewing_log, Warn)
 
 namespace fcitx {
 
 namespace {
 
-constexpr int CHEWING_MAX_LEN = 18;
+// Wait for the dictionary files to settle before reloading them.
+constexpr uint64_t DICTIONARY_RELOAD_DELAY = 1000000;
+
+// Consecutive slow events before stepping down to cheaper behavior, and fast
+// events before stepping back up.
+constexpr int SLOW_EVENTS_TO_DEGRADE = 3;
+constexpr int FAST_EVENTS_TO_RECOVER = 200;
+
+// Longer compositions are not saved for restoring.
+constexpr size_t MAX_COMPOSED_INPUT = 256;
+
+// Do not prefetch the dictionary again on every focus change.
+constexpr auto WARM_UP_INTERVAL = std::chrono::seconds(30);
+
+ChewingPageFaults currentPageFaults() {
+    struct rusage usage;
+#ifdef RUSAGE_THREAD
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+#else
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+#endif
+        return {};
+    }
+    return {usage.ru_majflt, usage.ru_minflt};
+}
+
+// Dictionary files first, then the user phrase database.
+std::vector<std::filesystem::path> dictionaryFiles() {
+    std::vector<std::filesystem::path> files;
+    const auto &sp = StandardPaths::global();
+    for (const auto &dir :
+         sp.locateAll(StandardPathsType::Data, "libchewing")) {
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+            if (entry.is_regular_file(ec) &&
+                entry.path().extension() == ".dat") {
+                files.push_back(entry.path());
+            }
+        }
+    }
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(
+             sp.userDirectory(StandardPathsType::Data) / "chewing", ec)) {
+        if (entry.is_regular_file(ec)) {
+            files.push_back(entry.path());
+        }
+    }
+    return files;
+}
+
+// Ask the kernel to read the files into page cache, up to budget bytes.
+void warmUpFiles(const std::vector<std::filesystem::path> &files,
+                 uint64_t budget) {
+    for (const auto &file : files) {
+        if (budget == 0) {
+            break;
+        }
+        UnixFD fd = UnixFD::own(open(file.c_str(), O_RDONLY | O_CLOEXEC));
+        struct stat st;
+        if (!fd.isValid() || fstat(fd.fd(), &st) != 0 || st.st_size <= 0) {
+            continue;
+        }
+        const auto length =
+            std::min<uint64_t>(static_cast<uint64_t>(st.st_size), budget);
+        posix_fadvise(fd.fd(), 0, static_cast<off_t>(length),
+                      POSIX_FADV_WILLNEED);
+        budget -= length;
+    }
+}
 
 constexpr auto builtin_selectkeys = std::to_array<std::string_view>({
     "1234567890",
@@ -75,47 +156,145 @@ DEFINE_SAFE_CHEWING_STRING_GETTER(commit);
 
 class ChewingCandidateWord : public CandidateWord {
 public:
-    ChewingCandidateWord(ChewingEngine *engine, std::string str, int index)
-        : CandidateWord(Text(std::move(str))), engine_(engine), index_(index) {}
+    ChewingCandidateWord(ChewingEngine *engine, int index)
+        : engine_(engine), index_(index) {}
+
+    // Return false if the word is not changed.
+    bool setWord(std::string_view str) {
+        if (word_ == str) {
+            return false;
+        }
+        word_ = str;
+        setText(Text(word_));
+        return true;
+    }
+    const std::string &word() const { return word_; }
 
     void select(InputContext *inputContext) const override {
-        auto *ctx = engine_->context();
-        auto pageSize = chewing_get_candPerPage(ctx);
-        int page = (index_ / pageSize) + chewing_cand_CurrentPage(ctx);
-        int off = index_ % pageSize;
-        if (page < 0 || page >= chewing_cand_TotalPage(ctx)) {
+        const auto start = ChewingTraceWriter::clock::now();
+        const auto faults = engine_->pageFaults();
+        CHEWING_PROBE1(select_entry, index_);
+        const bool selected = selectImpl(inputContext);
+        CHEWING_PROBE2(select_return, index_, selected ? 1 : 0);
+        // A selection done by a key is recorded as the key.
+        if (engine_->handlingKey()) {
             return;
         }
-        int lastPage = chewing_cand_CurrentPage(ctx);
-        while (page != chewing_cand_CurrentPage(ctx)) {
-            if (page < chewing_cand_CurrentPage(ctx)) {
-                chewing_handle_Left(ctx);
-            }
-            if (page > chewing_cand_CurrentPage(ctx)) {
-                chewing_handle_Right(ctx);
-            }
-            /* though useless, but take care if there is a bug cause freeze */
-            if (lastPage == chewing_cand_CurrentPage(ctx)) {
-                break;
-            }
-            lastPage = chewing_cand_CurrentPage(ctx);
+        if (auto *trace = engine_->trace()) {
+            trace->writeSelect(start, index_);
         }
-        chewing_handle_Default(ctx, builtin_selectkeys[static_cast<int>(
-                                        *engine_->config().SelectionKey)][off]);
+        if (selected) {
+            engine_->recordInput(
+                {ChewingTraceRecordType::Select, Key(), index_});
+        }
+        engine_->checkLatency(inputContext, "select", start, faults);
+    }
 
-        if (chewing_keystroke_CheckIgnore(ctx)) {
-            return;
+private:
+    bool selectImpl(InputContext *inputContext) const {
+        auto *ctx = engine_->context();
+        auto pageSize = chewing_get_candPerPage(ctx);
+        // index_ is on the current page. chewing_ack drops the result of the
+        // last key, so commit_Check only reports this selection.
+        const int index = (chewing_cand_CurrentPage(ctx) * pageSize) + index_;
+        if (index < 0 || index >= chewing_cand_TotalChoice(ctx)) {
+            return false;
+        }
+        engine_->saveReading();
+        chewing_ack(ctx);
+        CHEWING_PROBE1(handle_entry, index);
+        const auto handleStart = ChewingTraceWriter::clock::now();
+        const int ret = chewing_cand_choose_by_index(ctx, index);
+        engine_->addLibchewingTime(ChewingTraceWriter::clock::now() -
+                                   handleStart);
+        CHEWING_PROBE2(handle_return, ret, chewing_buffer_Len(ctx));
+        if (ret != 0) {
+            return false;
         }
 
         if (chewing_commit_Check(ctx)) {
-            inputContext->commitString(safeChewing_commit_String(ctx));
+            engine_->commitText(inputContext);
         }
         engine_->updateUI(inputContext);
+        engine_->showPrediction(inputContext);
+        return true;
     }
 
-private:
     ChewingEngine *engine_;
     int index_;
+    std::string word_;
+};
+
+class ChewingPredictionWord : public CandidateWord {
+public:
+    ChewingPredictionWord(ChewingEngine *engine, std::string phrase)
+        : CandidateWord(Text(phrase)), engine_(engine),
+          phrase_(std::move(phrase)) {}
+
+    const std::string &phrase() const { return phrase_; }
+
+    void select(InputContext *inputContext) const override {
+        // The list, and this word, is replaced by the selection.
+        engine_->selectPrediction(inputContext, phrase_);
+    }
+
+private:
+    ChewingEngine *engine_;
+    std::string phrase_;
+};
+
+// Phrases predicted after a commit, shown while nothing is being composed.
+class ChewingPredictionList : public CandidateList {
+public:
+    ChewingPredictionList(ChewingEngine *engine,
+                          std::vector<std::string> phrases)
+        : engine_(engine) {
+        const auto selectKeys = builtin_selectkeys[static_cast<int>(
+            *engine_->config().SelectionKey)];
+        for (size_t i = 0; i < phrases.size() && i < selectKeys.size(); i++) {
+            const char label[] = {selectKeys[i], '.', '\0'};
+            labels_.emplace_back(label);
+            words_.push_back(std::make_unique<ChewingPredictionWord>(
+                engine, std::move(phrases[i])));
+        }
+    }
+
+    const Text &label(int idx) const override {
+        if (idx < 0 || idx >= size()) {
+            throw std::invalid_argument("Invalid index");
+        }
+        return labels_[idx];
+    }
+    const CandidateWord &candidate(int idx) const override {
+        if (idx < 0 || idx >= size()) {
+            throw std::invalid_argument("Invalid index");
+        }
+        return *words_[idx];
+    }
+    int size() const override { return words_.size(); }
+    int cursorIndex() const override { return -1; }
+    CandidateLayoutHint layoutHint() const override {
+        switch (*engine_->config().CandidateLayout) {
+        case ChewingCandidateLayout::Horizontal:
+            return CandidateLayoutHint::Horizontal;
+        case ChewingCandidateLayout::Vertical:
+            return CandidateLayoutHint::Vertical;
+        }
+        return CandidateLayoutHint::Horizontal;
+    }
+
+    size_t bytes() const {
+        size_t bytes = 0;
+        for (const auto &word : words_) {
+            bytes += word->phrase().size();
+        }
+        return bytes;
+    }
+
+private:
+    ChewingEngine *engine_;
+    std::vector<std::unique_ptr<ChewingPredictionWord>> words_;
+    std::vector<Text> labels_;
 };
 
 class ChewingCandidateList : public CandidateList,
@@ -145,36 +324,60 @@ public:
         return *candidateWords_[idx];
     }
 
-    void fillCandidate() {
+    // Candidate words and labels are kept across fills and only their text is
+    // replaced, so refilling a page does not free and allocate the words.
+    // Return true if anything visible is changed.
+    bool fillCandidate() {
         auto *ctx = engine_->context();
-        candidateWords_.clear();
-        labels_.clear();
+        CHEWING_PROBE1(fill_candidate_entry, chewing_cand_CurrentPage(ctx));
+        const int oldSize = size_;
+        bool changed = cursor_ != 0;
+        size_ = 0;
         cursor_ = 0;
 
-        int index = 0;
         // get candidate word
         int pageSize = chewing_cand_ChoicePerPage(ctx);
         if (pageSize <= 0) {
-            return;
+            CHEWING_PROBE1(fill_candidate_return, 0);
+            return changed || oldSize != 0;
         }
-        chewing_cand_Enumerate(ctx);
-        while (chewing_cand_hasNext(ctx) && index < pageSize) {
-            candidateWords_.emplace_back(std::make_unique<ChewingCandidateWord>(
-                engine_, chewing_cand_String_static(ctx), index));
-            if (index < 10) {
-                const char label[] = {
-                    builtin_selectkeys[static_cast<int>(
-                        *engine_->config().SelectionKey)][index],
-                    '.', '\0'};
-                labels_.emplace_back(label);
-            } else {
-                labels_.emplace_back();
+        if (labelKey_ != *engine_->config().SelectionKey) {
+            labelKey_ = *engine_->config().SelectionKey;
+            for (size_t i = 0; i < labels_.size(); i++) {
+                labels_[i] = makeLabel(i);
             }
-            index++;
+            changed = true;
+        }
+        auto addWord = [this, &changed](std::string_view word) {
+            if (static_cast<size_t>(size_) == candidateWords_.size()) {
+                candidateWords_.push_back(
+                    std::make_unique<ChewingCandidateWord>(engine_, size_));
+                labels_.push_back(makeLabel(size_));
+            }
+            if (candidateWords_[size_]->setWord(word)) {
+                changed = true;
+            }
+            size_++;
+        };
+        const int total = chewing_cand_TotalChoice(ctx);
+        for (int i = chewing_cand_CurrentPage(ctx) * pageSize;
+             i < total && size_ < pageSize; i++) {
+            addWord(chewing_cand_string_by_index_static(ctx, i));
+        }
+        CHEWING_PROBE1(fill_candidate_return, size_);
+        return changed || oldSize != size_;
+    }
+
+    // Size of the candidate text of current page.
+    size_t bytes() const {
+        size_t bytes = 0;
+        for (int i = 0; i < size_; i++) {
+            bytes += candidateWords_[i]->word().size();
         }
+        return bytes;
     }
 
-    int size() const override { return candidateWords_.size(); }
+    int size() const override { return size_; }
     int cursorIndex() const override {
         if (empty() || !*engine_->config().selectCandidateWithArrowKey) {
             return -1;
@@ -228,13 +431,26 @@ public:
     }
 
 private:
+    Text makeLabel(int index) const {
+        if (index >= 10) {
+            return {};
+        }
+        const char label[] = {
+            builtin_selectkeys[static_cast<int>(labelKey_)][index], '.', '\0'};
+        return Text(label);
+    }
+
     void paging(bool prev) {
-        if (candidateWords_.empty()) {
+        if (empty()) {
             return;
         }
+        const auto start = ChewingTraceWriter::clock::now();
 
         auto *ctx = engine_->context();
         const int currentPage = chewing_cand_CurrentPage(ctx);
+        CHEWING_PROBE1(handle_entry,
+                       prev ? FcitxKey_Page_Up : FcitxKey_Page_Down);
+        const auto handleStart = ChewingTraceWriter::clock::now();
         if (prev) {
             const int hasNext = chewing_cand_list_has_next(ctx);
             const int hasPrev = chewing_cand_list_has_prev(ctx);
@@ -251,22 +467,71 @@ private:
                 chewing_handle_PageDown(ctx);
             }
         }
+        engine_->addLibchewingTime(ChewingTraceWriter::clock::now() -
+                                   handleStart);
+        CHEWING_PROBE2(handle_return, chewing_keystroke_CheckAbsorb(ctx),
+                       chewing_buffer_Len(ctx));
 
         if (chewing_keystroke_CheckAbsorb(ctx)) {
             fillCandidate();
             engine_->updatePreedit(ic_);
-            ic_->updatePreedit();
             ic_->updateUserInterface(UserInterfaceComponent::InputPanel);
         }
+        if (engine_->handlingKey()) {
+            return;
+        }
+        if (auto *trace = engine_->trace()) {
+            trace->writePage(start, prev);
+        }
+        engine_->recordInput(
+            {ChewingTraceRecordType::Page, Key(), prev ? -1 : 1});
     }
 
     ChewingEngine *engine_;
     InputContext *ic_;
     std::vector<std::unique_ptr<ChewingCandidateWord>> candidateWords_;
     std::vector<Text> labels_;
+    ChewingSelectionKey labelKey_ = ChewingSelectionKey::CSK_Digit;
+    int size_ = 0;
     int cursor_ = 0;
 };
 
+// Keys that need nothing from libchewing when nothing is being composed, so
+// they can be passed to the application without touching libchewing at all.
+// Besides the keys libchewing ignores, this is English typed with CapsLock.
+bool isIgnoredWhenIdle(const Key &key) {
+    if (key.states().test(KeyState::CapsLock) && key.isSimple() &&
+        (key.isLAZ() || key.isUAZ())) {
+        return true;
+    }
+    static const KeyList keys{Key{FcitxKey_Return},
+                              Key{FcitxKey_KP_Enter},
+                              Key{FcitxKey_Escape},
+                              Key{FcitxKey_BackSpace},
+                              Key{FcitxKey_Delete},
+                              Key{FcitxKey_Tab},
+                              Key{FcitxKey_Up},
+                              Key{FcitxKey_Down},
+                              Key{FcitxKey_Left},
+                              Key{FcitxKey_Right},
+                              Key{FcitxKey_Home},
+                              Key{FcitxKey_End},
+                              Key{FcitxKey_Page_Up},
+                              Key{FcitxKey_Page_Down},
+                              Key{FcitxKey_Left, KeyState::Shift},
+                              Key{FcitxKey_Right, KeyState::Shift}};
+    return key.checkKeyList(keys);
+}
+
+// Keys typed into password and sensitive fields are passed to the
+// application as they are, nothing of them reaches libchewing, the trace or
+// the prediction.
+bool isPassthrough(const InputContext *ic) {
+    const auto flags = ic->capabilityFlags();
+    return flags.test(CapabilityFlag::Password) ||
+           flags.test(CapabilityFlag::Sensitive);
+}
+
 void logger(void * /*context*/, int /*level*/, const char *fmt, ...) {
     if (!chewing_log().checkLogLevel(Debug)) {
         return;
@@ -288,6 +553,13 @@ void logger(void * /*context*/, int /*level*/, const char *fmt, ...) {
     CHEWING_DEBUG() << buf.data();
 }
 
+// Input method entries with a fixed layout, see chewing-*.conf.in. Other
+// entries use the layout from the config.
+constexpr std::pair<std::string_view, ChewingLayout> fixedLayoutEntries[] = {
+    {"chewing-hsu", ChewingLayout::Hsu},
+    {"chewing-pinyin", ChewingLayout::HanYuPinYin},
+};
+
 } // namespace
 
 ChewingContext *getChewingContext() {
@@ -301,14 +573,237 @@ ChewingContext *getChewingContext() {
     return chewing_new();
 }
 
-ChewingEngine::ChewingEngine(Instance *instance)
-    : instance_(instance), context_(getChewingContext()) {
-    chewing_set_maxChiSymbolLen(context_.get(), CHEWING_MAX_LEN);
-    chewing_set_logger(context_.get(), logger, nullptr);
+ChewingEngine::ChewingEngine(Instance *instance) : instance_(instance) {
     reloadConfig();
+    selectContext("chewing");
+    dispatcher_.attach(&instance_->eventLoop());
+    watchDictionary();
+}
+
+ChewingEngine::~ChewingEngine() {
+    saveComposition();
+    if (dictionaryLoader_.joinable()) {
+        dictionaryLoader_.join();
+    }
+    if (warmUpThread_.joinable()) {
+        warmUpThread_.join();
+    }
+}
+
+void ChewingEngine::setupContext(ChewingContext *ctx) {
+    chewing_set_logger(ctx, logger, nullptr);
+}
+
+ChewingLayout ChewingEngine::layout(std::string_view entry) const {
+    for (const auto &[name, layout] : fixedLayoutEntries) {
+        if (name == entry) {
+            return layout;
+        }
+    }
+    return *config_.Layout;
+}
+
+void ChewingEngine::selectContext(const std::string &entry) {
+    if (context_ && entry_ == entry) {
+        return;
+    }
+    auto &ctx = contexts_[entry];
+    // Each entry keeps its own context once used, so switching between the
+    // entries does not need to reconfigure anything. Contexts of the enabled
+    // entries are usually created ahead by warmUpDictionary.
+    if (!ctx) {
+        CHEWING_DEBUG() << "Create context for " << entry;
+        ctx.reset(getChewingContext());
+        setupContext(ctx.get());
+        configureContext(ctx.get(), layout(entry));
+    }
+    entry_ = entry;
+    context_ = ctx.get();
+}
+
+void ChewingEngine::watchDictionary() {
+    dictionaryWatchFD_.give(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (!dictionaryWatchFD_.isValid()) {
+        return;
+    }
+    bool watched = false;
+    for (const auto &dir : StandardPaths::global().locateAll(
+             StandardPathsType::Data, "libchewing")) {
+        if (!std::filesystem::is_directory(dir)) {
+            continue;
+        }
+        if (inotify_add_watch(dictionaryWatchFD_.fd(), dir.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                                  IN_DELETE) >= 0) {
+            CHEWING_DEBUG() << "Watch dictionary directory: " << dir.string();
+            watched = true;
+        }
+    }
+    if (!watched) {
+        dictionaryWatchFD_.reset();
+        return;
+    }
+    dictionaryWatcher_ = instance_->eventLoop().addIOEvent(
+        dictionaryWatchFD_.fd(), IOEventFlag::In,
+        [this](EventSourceIO *, int fd, IOEventFlags) {
+            alignas(inotify_event) char buf[4096];
+            bool changed = false;
+            ssize_t len;
+            while ((len = read(fd, buf, sizeof(buf))) > 0) {
+                for (char *ptr = buf; ptr < buf + len;) {
+                    const auto *event =
+                        reinterpret_cast<const inotify_event *>(ptr);
+                    // The user phrase database may live in the same
+                    // directory, only react to the dictionary itself.
+                    if (event->len) {
+                        std::string_view name(event->name);
+                        if (name == "tsi.dat" || name == "word.dat") {
+                            changed = true;
+                        }
+                    }
+                    ptr += sizeof(inotify_event) + event->len;
+                }
+            }
+            if (changed) {
+                scheduleReloadDictionary();
+            }
+            return true;
+        });
 }
 
-ChewingEngine::~ChewingEngine() = default;
+void ChewingEngine::warmUpDictionary() {
+    // Still running, or its contexts are not taken yet.
+    if (warmUpThread_.joinable()) {
+        return;
+    }
+    auto budget = static_cast<uint64_t>(*config_.WarmUpBudget) << 20;
+    const auto now = std::chrono::steady_clock::now();
+    if (lastWarmUp_ && now - *lastWarmUp_ < WARM_UP_INTERVAL) {
+        budget = 0;
+    }
+
+    // Other enabled entries of this engine, so switching to them does not
+    // wait for a dictionary load.
+    std::vector<std::string> entries;
+    auto &imManager = instance_->inputMethodManager();
+    for (const auto &groupName : imManager.groups()) {
+        const auto *group = imManager.group(groupName);
+        if (!group) {
+            continue;
+        }
+        for (const auto &item : group->inputMethodList()) {
+            const auto *entry = imManager.entry(item.name());
+            if (entry && entry->addon() == "chewing" &&
+                !contexts_.contains(item.name()) &&
+                std::ranges::find(entries, item.name()) == entries.end()) {
+                entries.push_back(item.name());
+            }
+        }
+    }
+    if (budget == 0 && entries.empty()) {
+        return;
+    }
+
+    if (budget != 0) {
+        lastWarmUp_ = now;
+    }
+
+    CHEWING_DEBUG() << "Prefetch " << (budget >> 20)
+                    << "MiB of dictionary files, create " << entries.size()
+                    << " contexts";
+    warmUpThread_ = std::thread([this, budget, entries = std::move(entries)]() {
+        if (budget != 0) {
+            warmUpFiles(dictionaryFiles(), budget);
+        }
+        for (const auto &entry : entries) {
+            if (auto *ctx = getChewingContext()) {
+                warmedContexts_[entry].reset(ctx);
+            }
+        }
+        dispatcher_.schedule([this]() {
+            warmUpThread_.join();
+            for (auto &[entry, ctx] : warmedContexts_) {
+                // The entry may have been used in the meantime.
+                auto &current = contexts_[entry];
+                if (!current) {
+                    setupContext(ctx.get());
+                    configureContext(ctx.get(), layout(entry));
+                    current = std::move(ctx);
+                }
+            }
+            warmedContexts_.clear();
+        });
+    });
+}
+
+void ChewingEngine::scheduleReloadDictionary() {
+    const auto time = now(CLOCK_MONOTONIC) + DICTIONARY_RELOAD_DELAY;
+    if (dictionaryReloadTimer_) {
+        dictionaryReloadTimer_->setTime(time);
+        dictionaryReloadTimer_->setOneShot();
+        return;
+    }
+    dictionaryReloadTimer_ = instance_->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, time, 0, [this](EventSourceTime *, uint64_t) {
+            reloadDictionary();
+            return true;
+        });
+}
+
+void ChewingEngine::reloadDictionary() {
+    if (dictionaryLoader_.joinable()) {
+        reloadDictionaryAgain_ = true;
+        return;
+    }
+    CHEWING_DEBUG() << "Dictionary changed, loading new context";
+    std::vector<std::string> entries;
+    for (const auto &[entry, _] : contexts_) {
+        entries.push_back(entry);
+    }
+    dictionaryLoader_ = std::thread([this, entries = std::move(entries)]() {
+        for (const auto &entry : entries) {
+            // Keep the old context if the new dictionary fails to load.
+            if (auto *ctx = getChewingContext()) {
+                loadedContexts_[entry].reset(ctx);
+            }
+        }
+        dispatcher_.schedule([this, count = entries.size()]() {
+            dictionaryLoader_.join();
+            if (loadedContexts_.size() < count) {
+                CHEWING_WARN() << "Failed to load the changed dictionary, "
+                                  "keep using the old one";
+            }
+            for (auto &[entry, ctx] : loadedContexts_) {
+                pendingContexts_[entry] = std::move(ctx);
+            }
+            loadedContexts_.clear();
+            if (reloadDictionaryAgain_) {
+                reloadDictionaryAgain_ = false;
+                reloadDictionary();
+            }
+            if (state_ == ChewingCompositionState::Idle) {
+                swapContext();
+            }
+        });
+    });
+}
+
+void ChewingEngine::swapContext() {
+    if (pendingContexts_.empty()) {
+        return;
+    }
+    CHEWING_DEBUG() << "Switch to reloaded dictionary";
+    for (auto &[entry, ctx] : pendingContexts_) {
+        if (!ctx) {
+            continue;
+        }
+        setupContext(ctx.get());
+        configureContext(ctx.get(), layout(entry));
+        contexts_[entry] = std::move(ctx);
+    }
+    pendingContexts_.clear();
+    context_ = contexts_[entry_].get();
+}
 
 void ChewingEngine::reloadConfig() {
     readAsIni(config_, "conf/chewing.conf");
@@ -316,13 +811,43 @@ void ChewingEngine::reloadConfig() {
 }
 
 void ChewingEngine::populateConfig() {
-    ChewingContext *ctx = context_.get();
+    for (const auto &[entry, ctx] : contexts_) {
+        configureContext(ctx.get(), layout(entry));
+    }
+
+    if (*config_.Prediction) {
+        if (!predictor_) {
+            predictor_ = std::make_unique<ChewingPredictor>(predictionFile());
+        }
+    } else {
+        predictor_.reset();
+        predictNext_ = false;
+    }
+
+    if (*config_.RecordTrace) {
+        if (!trace_) {
+            trace_ = ChewingTraceWriter::create();
+            if (trace_) {
+                CHEWING_DEBUG()
+                    << "Record trace to " << trace_->path().string();
+            }
+        }
+        if (trace_) {
+            RawConfig config;
+            config_.save(config);
+            trace_->writeConfig(config);
+        }
+    } else {
+        trace_.reset();
+    }
+}
 
+void ChewingEngine::configureContext(ChewingContext *ctx,
+                                     ChewingLayout layout) {
     CHEWING_DEBUG() << "Set layout to: "
-                    << builtin_keymaps[static_cast<int>(*config_.Layout)];
+                    << builtin_keymaps[static_cast<int>(layout)];
     chewing_set_KBType(
-        ctx,
-        chewing_KBStr2Num(builtin_keymaps[static_cast<int>(*config_.Layout)]));
+        ctx, chewing_KBStr2Num(builtin_keymaps[static_cast<int>(layout)]));
 
     chewing_set_ChiEngMode(ctx, CHINESE_MODE);
 
@@ -334,6 +859,7 @@ void ChewingEngine::populateConfig() {
 
     chewing_set_selKey(ctx, selkey, 10);
     chewing_set_candPerPage(ctx, *config_.PageSize);
+    chewing_set_maxChiSymbolLen(ctx, maxPreeditLength());
     chewing_set_addPhraseDirection(ctx, *config_.AddPhraseForward ? 0 : 1);
     chewing_set_phraseChoiceRearward(ctx, *config_.ChoiceBackward ? 1 : 0);
     chewing_set_autoShiftCur(ctx, *config_.AutoShiftCursor ? 1 : 0);
@@ -341,13 +867,24 @@ void ChewingEngine::populateConfig() {
     chewing_set_escCleanAllBuf(ctx, 1);
 }
 
-void ChewingEngine::reset(const InputMethodEntry & /*entry*/,
+void ChewingEngine::reset(const InputMethodEntry &entry,
                           InputContextEvent &event) {
+    const auto start = ChewingTraceWriter::clock::now();
+    selectContext(entry.uniqueName());
     doReset(event);
+    if (predictor_) {
+        predictor_->resetHistory();
+    }
+    if (trace_) {
+        trace_->writeEvent(ChewingTraceRecordType::Reset, start);
+    }
 }
 
 void ChewingEngine::doReset(InputContextEvent &event) {
-    ChewingContext *ctx = context_.get();
+    // The frontend may have cleared the panel, always send the new state.
+    lastPreeditIC_.unwatch();
+    reverseLookup_.clear();
+    ChewingContext *ctx = context_;
     chewing_cand_close(ctx);
     chewing_clean_preedit_buf(ctx);
     chewing_clean_bopomofo_buf(ctx);
@@ -355,10 +892,165 @@ void ChewingEngine::doReset(InputContextEvent &event) {
     updateUI(event.inputContext());
 }
 
-void ChewingEngine::save() {}
+void ChewingEngine::save() {
+    if (trace_) {
+        trace_->flush();
+    }
+    if (predictor_) {
+        predictor_->sync();
+    }
+    saveComposition();
+}
+
+std::filesystem::path ChewingEngine::compositionFile() {
+    return StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+           "chewing" / "composition.bin";
+}
+
+std::filesystem::path ChewingEngine::predictionFile() {
+    return StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+           "chewing" / "prediction.bin";
+}
+
+void ChewingEngine::recordInput(const ChewingComposedInput &input) {
+    if (restoring_) {
+        return;
+    }
+    if (state_ == ChewingCompositionState::Idle) {
+        // Do not replay a committed composition after a crash.
+        if (compositionSaved_) {
+            removeComposition();
+        }
+        return;
+    }
+    if (!*config_.RestoreComposition) {
+        return;
+    }
+    if (composedInput_.size() >= MAX_COMPOSED_INPUT) {
+        composedInputOverflow_ = true;
+        return;
+    }
+    composedInput_.push_back(input);
+}
+
+void ChewingEngine::saveComposition() {
+    // Do not overwrite the saved composition before it is restored.
+    if (!compositionRestoreChecked_) {
+        return;
+    }
+    if (!*config_.RestoreComposition || composedInputOverflow_) {
+        removeComposition();
+        return;
+    }
+    // Keep the composition saved on focus out, it is restored after a
+    // restart.
+    if (composedInput_.empty() || ic_.isNull()) {
+        return;
+    }
+    auto writer = ChewingTraceWriter::create(compositionFile());
+    if (!writer) {
+        return;
+    }
+    RawConfig info;
+    info.setValueByPath("Entry", entry_);
+    info.setValueByPath("Program", ic_.get()->program());
+    writer->writeConfig(info);
+    const auto now = ChewingTraceWriter::clock::now();
+    for (const auto &input : composedInput_) {
+        switch (input.type) {
+        case ChewingTraceRecordType::Key:
+            writer->writeKey(now, input.key, true);
+            break;
+        case ChewingTraceRecordType::Select:
+            writer->writeSelect(now, input.index);
+            break;
+        case ChewingTraceRecordType::Page:
+            writer->writePage(now, input.index < 0);
+            break;
+        default:
+            break;
+        }
+    }
+    writer->flush();
+    compositionSaved_ = true;
+}
+
+void ChewingEngine::removeComposition() {
+    compositionSaved_ = false;
+    std::error_code ec;
+    std::filesystem::remove(compositionFile(), ec);
+}
+
+void ChewingEngine::restoreComposition() {
+    std::vector<ChewingTraceRecord> records;
+    {
+        ChewingTraceReader reader(compositionFile());
+        while (auto record = reader.next()) {
+            records.push_back(std::move(*record));
+        }
+    }
+    removeComposition();
+    // The input context may be gone or already composing since activation.
+    auto *ic = ic_.get();
+    if (!ic || !ic->hasFocus() || isPassthrough(ic) ||
+        state_ != ChewingCompositionState::Idle) {
+        return;
+    }
+    // Only restore into the same program with the same input method.
+    if (records.empty() ||
+        records[0].type != ChewingTraceRecordType::Config ||
+        records[0].config.valueByPath("Entry") == nullptr ||
+        *records[0].config.valueByPath("Entry") != entry_ ||
+        records[0].config.valueByPath("Program") == nullptr ||
+        *records[0].config.valueByPath("Program") != ic->program()) {
+        return;
+    }
+    CHEWING_DEBUG() << "Restore composition of " << ic->program();
+    // Selection and paging are recorded below, like a key.
+    restoring_ = true;
+    handlingKey_ = true;
+    for (size_t i = 1; i < records.size(); i++) {
+        const auto &record = records[i];
+        auto candidateList = ic->inputPanel().candidateList();
+        switch (record.type) {
+        case ChewingTraceRecordType::Key: {
+            KeyEvent event(ic, record.key);
+            keyEventImpl(event);
+            break;
+        }
+        case ChewingTraceRecordType::Select:
+            if (!candidateList || record.index >= candidateList->size()) {
+                continue;
+            }
+            candidateList->candidate(record.index).select(ic);
+            break;
+        case ChewingTraceRecordType::Page:
+            if (!candidateList || !candidateList->toPageable()) {
+                continue;
+            }
+            if (record.index < 0) {
+                candidateList->toPageable()->prev();
+            } else {
+                candidateList->toPageable()->next();
+            }
+            break;
+        default:
+            continue;
+        }
+        if (state_ == ChewingCompositionState::Idle) {
+            composedInput_.clear();
+        } else {
+            composedInput_.push_back({record.type, record.key, record.index});
+        }
+    }
+    handlingKey_ = false;
+    restoring_ = false;
+    updateUI(ic);
+}
 
-void ChewingEngine::activate(const InputMethodEntry & /*entry*/,
+void ChewingEngine::activate(const InputMethodEntry &entry,
                              InputContextEvent &event) {
+    const auto start = ChewingTraceWriter::clock::now();
     // Request chttrans.
     // Fullwidth is not required for chewing.
     chttrans();
@@ -370,16 +1062,62 @@ void ChewingEngine::activate(const InputMethodEntry & /*entry*/,
     auto *ic = event.inputContext();
     if (!ic_.isNull() && ic_.get() != ic) {
         doReset(event);
+        if (predictor_) {
+            predictor_->resetHistory();
+        }
     }
+    selectContext(entry.uniqueName());
+    lastPreeditIC_.unwatch();
     ic_ = ic->watch();
+    if (isPassthrough(ic)) {
+        return;
+    }
+    warmUpDictionary();
+    // Replay the composition saved before the restart once the activation
+    // is done.
+    if (!compositionRestoreChecked_ && !compositionRestoreEvent_) {
+        compositionRestoreEvent_ =
+            instance_->eventLoop().addDeferEvent([this](EventSource *) {
+                compositionRestoreChecked_ = true;
+                if (*config_.RestoreComposition) {
+                    restoreComposition();
+                }
+                return true;
+            });
+    }
+    if (trace_) {
+        trace_->writeActivate(start, entry.uniqueName());
+    }
 }
 
 void ChewingEngine::deactivate(const InputMethodEntry &entry,
                                InputContextEvent &event) {
+    const auto start = ChewingTraceWriter::clock::now();
+    selectContext(entry.uniqueName());
+    if (compositionRestoreChecked_ &&
+        state_ != ChewingCompositionState::Idle) {
+        // Switching input methods commits or drops the composition, and
+        // fcitx or the client commits the client preedit on focus out. Only
+        // keep a composition that would be lost, to restore it later.
+        if (event.type() != EventType::InputContextSwitchInputMethod &&
+            !event.inputContext()->capabilityFlags().test(
+                CapabilityFlag::Preedit)) {
+            saveComposition();
+        } else if (compositionSaved_) {
+            removeComposition();
+        }
+    }
     if (event.type() == EventType::InputContextSwitchInputMethod) {
         flushBuffer(event);
     } else {
-        reset(entry, event);
+        doReset(event);
+    }
+    if (predictor_) {
+        predictor_->resetHistory();
+    }
+    if (trace_) {
+        trace_->writeEvent(ChewingTraceRecordType::Deactivate, start);
+        trace_->flush();
     }
 }
 
@@ -460,11 +1198,78 @@ void ChewingEngine::keyEvent(const InputMethodEntry &entry,
     if (keyEvent.isRelease()) {
         return;
     }
-    auto *ctx = context_.get();
+    selectContext(entry.uniqueName());
+    if (isPassthrough(keyEvent.inputContext())) {
+        // The field may have become sensitive while composing.
+        if (state_ != ChewingCompositionState::Idle) {
+            doReset(keyEvent);
+        }
+        return;
+    }
+    const auto start = ChewingTraceWriter::clock::now();
+    const auto faults = pageFaults();
+    updateUITime_ = {};
+    libchewingTime_ = {};
+    CHEWING_PROBE2(key_event_entry, keyEvent.key().sym(),
+                   static_cast<uint32_t>(keyEvent.key().states()));
+    if (!pendingContexts_.empty() && state_ == ChewingCompositionState::Idle) {
+        swapContext();
+    }
+    handlingKey_ = true;
+    keyEventImpl(keyEvent);
+    handlingKey_ = false;
+    if (keyEvent.filtered()) {
+        recordInput({ChewingTraceRecordType::Key, keyEvent.rawKey()});
+    }
+    CHEWING_PROBE3(key_event_return, keyEvent.key().sym(),
+                   keyEvent.filtered() ? 1 : 0,
+                   chewing_buffer_Len(context_));
+    if (trace_) {
+        trace_->writeKey(start, keyEvent.key(), keyEvent.filtered());
+    }
+    checkLatency(keyEvent.inputContext(), "key", start, faults);
+}
+
+bool ChewingEngine::handlePredictionKeyEvent(const KeyEvent &keyEvent) {
     auto *ic = keyEvent.inputContext();
+    auto candidateList = std::dynamic_pointer_cast<ChewingPredictionList>(
+        ic->inputPanel().candidateList());
+    // Keep the prediction while a modifier is being pressed.
+    if (!candidateList || keyEvent.key().isModifier()) {
+        return false;
+    }
+    // Selection keys without Alt are bopomofo keys of most layouts.
+    if (keyEvent.key().states() == KeyState::Alt &&
+        keyEvent.key().sym() < 0x80) {
+        const auto selectKeys =
+            builtin_selectkeys[static_cast<int>(*config_.SelectionKey)];
+        if (auto index =
+                selectKeys.find(static_cast<char>(keyEvent.key().sym()));
+            index != std::string_view::npos &&
+            static_cast<int>(index) < candidateList->size()) {
+            candidateList->candidate(index).select(ic);
+            return true;
+        }
+    }
+    // Any other key dismisses the prediction and is handled as usual.
+    ic->inputPanel().setCandidateList(nullptr);
+    ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+    return keyEvent.key().check(FcitxKey_Escape);
+}
 
-    chewing_set_easySymbolInput(ctx, 0);
+void ChewingEngine::keyEventImpl(KeyEvent &keyEvent) {
     CHEWING_DEBUG() << "KeyEvent: " << keyEvent.key().toString();
+    if (handlePredictionKeyEvent(keyEvent)) {
+        keyEvent.filterAndAccept();
+        return;
+    }
+    if (state_ == ChewingCompositionState::Idle &&
+        isIgnoredWhenIdle(keyEvent.key())) {
+        return;
+    }
+    auto *ctx = context_;
+    auto *ic = keyEvent.inputContext();
+    saveReading();
 
     if (handleCandidateKeyEvent(keyEvent)) {
         keyEvent.filterAndAccept();
@@ -472,26 +1277,37 @@ void ChewingEngine::keyEvent(const InputMethodEntry &entry,
     }
 
     int chewingReturnValue = 0;
+    CHEWING_PROBE1(handle_entry, keyEvent.key().sym());
+    const auto handleStart = ChewingTraceWriter::clock::now();
     if (keyEvent.key().check(FcitxKey_space)) {
         chewingReturnValue = chewing_handle_Space(ctx);
     } else if (keyEvent.key().check(FcitxKey_Tab)) {
         chewingReturnValue = chewing_handle_Tab(ctx);
     } else if (keyEvent.key().isSimple()) {
-        if (keyEvent.rawKey().states().test(KeyState::Shift)) {
-            chewing_set_easySymbolInput(ctx, *config_.EasySymbolInput ? 1 : 0);
-        }
         int scan_code = keyEvent.key().sym() & 0xff;
-        if (*config_.Layout == ChewingLayout::HanYuPinYin) {
+#ifndef HAVE_CHEWING_PINYIN_LENGTH_FIX
+        if (layout(entry_) == ChewingLayout::HanYuPinYin) {
             auto zuin = safeChewing_bopomofo_String(ctx);
             // Workaround a bug in libchewing fixed in 2017 but never has
-            // stable release.
+            // stable release before 0.6.0.
             if (zuin.size() >= 9) {
                 keyEvent.filterAndAccept();
                 return;
             }
         }
+#endif
+        // Easy symbol input is kept off outside of this call, so it only need
+        // to be toggled for shifted keys.
+        const bool easySymbol =
+            *config_.EasySymbolInput &&
+            keyEvent.rawKey().states().test(KeyState::Shift);
+        if (easySymbol) {
+            chewing_set_easySymbolInput(ctx, 1);
+        }
         chewingReturnValue = chewing_handle_Default(ctx, scan_code);
-        chewing_set_easySymbolInput(ctx, 0);
+        if (easySymbol) {
+            chewing_set_easySymbolInput(ctx, 0);
+        }
     } else if (keyEvent.key().check(FcitxKey_BackSpace)) {
         if ((chewing_buffer_Check(ctx)) == 0 &&
             (chewing_bopomofo_Check(ctx) == 0)) {
@@ -501,7 +1317,7 @@ void ChewingEngine::keyEvent(const InputMethodEntry &entry,
         if ((chewing_buffer_Check(ctx)) == 0 &&
             (chewing_bopomofo_Check(ctx) == 0)) {
             keyEvent.filterAndAccept();
-            reset(entry, keyEvent);
+            doReset(keyEvent);
             return;
         }
     } else if (keyEvent.key().check(FcitxKey_Escape)) {
@@ -515,7 +1331,7 @@ void ChewingEngine::keyEvent(const InputMethodEntry &entry,
         if ((chewing_buffer_Check(ctx)) == 0 &&
             (chewing_bopomofo_Check(ctx) == 0)) {
             keyEvent.filterAndAccept();
-            reset(entry, keyEvent);
+            doReset(keyEvent);
             return;
         }
     } else if (keyEvent.key().check(FcitxKey_Up)) {
@@ -551,6 +1367,8 @@ void ChewingEngine::keyEvent(const InputMethodEntry &entry,
         return;
     }
 
+    libchewingTime_ += ChewingTraceWriter::clock::now() - handleStart;
+    CHEWING_PROBE2(handle_return, chewingReturnValue, chewing_buffer_Len(ctx));
     CHEWING_DEBUG() << "Chewing return value: " << chewingReturnValue;
     if (chewing_keystroke_CheckIgnore(ctx)) {
         CHEWING_DEBUG() << "Keystroke ignored";
@@ -562,106 +1380,366 @@ void ChewingEngine::keyEvent(const InputMethodEntry &entry,
     }
     if (chewing_commit_Check(ctx)) {
         keyEvent.filterAndAccept();
-        ic->commitString(safeChewing_commit_String(ctx));
+        commitText(ic);
     }
     updateUI(ic);
+    showPrediction(ic);
+}
+
+void ChewingEngine::commitText(InputContext *ic) {
+    auto commit = safeChewing_commit_String(context_);
+    lookupReading(commit);
+    learnPhrase(ic, commit);
+    // Text committed before restart is not committed again.
+    if (!restoring_) {
+        ic->commitString(commit);
+    }
+}
+
+void ChewingEngine::saveReading() {
+    reverseLookup_.clear();
+    readingPhones_.clear();
+    auto *ctx = context_;
+    if (!*config_.ReverseLookup || chewing_buffer_Len(ctx) == 0) {
+        return;
+    }
+    readingLength_ = chewing_buffer_Len(ctx);
+    const int phoneLength = chewing_get_phoneSeqLen(ctx);
+    UniqueCPtr<unsigned short, chewing_free> phones(
+        chewing_get_phoneSeq(ctx));
+    if (!phones || phoneLength <= 0) {
+        return;
+    }
+    readingPhones_.assign(phones.get(), phones.get() + phoneLength);
+}
+
+void ChewingEngine::lookupReading(std::string_view commit) {
+    reverseLookup_.clear();
+    auto length = utf8::lengthValidated(commit);
+    // The committed text is always taken from the front of the buffer saved
+    // before the key. Symbols in the buffer have no phone, skip the lookup
+    // if they make the phones not line up with the characters.
+    if (readingPhones_.empty() || length == utf8::INVALID_LENGTH ||
+        readingPhones_.size() != readingLength_ ||
+        length > readingPhones_.size()) {
+        return;
+    }
+    std::string reading;
+    char buf[32];
+    for (size_t i = 0; i < length; i++) {
+        if (chewing_phone_to_bopomofo(readingPhones_[i], buf, sizeof(buf)) <
+            0) {
+            return;
+        }
+        if (!reading.empty()) {
+            reading.push_back(' ');
+        }
+        reading.append(buf);
+    }
+    reverseLookup_ = stringutils::concat(commit, ": ", reading);
+    CHEWING_DEBUG() << "Reverse lookup: " << reverseLookup_;
+}
+
+void ChewingEngine::learnPhrase(InputContext *ic, std::string_view commit) {
+    if (!predictor_ || restoring_ || isPassthrough(ic)) {
+        return;
+    }
+    predictor_->learn(commit);
+    predictNext_ = true;
+}
+
+bool ChewingEngine::showPrediction(InputContext *ic) {
+    if (!std::exchange(predictNext_, false) || !predictor_ ||
+        state_ != ChewingCompositionState::Idle) {
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    auto phrases = predictor_->predict(*config_.PageSize);
+    CHEWING_DEBUG() << "Predict " << phrases.size() << " phrases in "
+                    << std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count()
+                    << "us";
+    if (phrases.empty()) {
+        return false;
+    }
+    auto candidateList =
+        std::make_unique<ChewingPredictionList>(this, std::move(phrases));
+    uiBytes_ += candidateList->bytes();
+    ic->inputPanel().setCandidateList(std::move(candidateList));
+    ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+    return true;
+}
+
+void ChewingEngine::selectPrediction(InputContext *ic, std::string phrase) {
+    ic->inputPanel().setCandidateList(nullptr);
+    ic->commitString(phrase);
+    learnPhrase(ic, phrase);
+    // Offer the phrases following the selected one.
+    if (!showPrediction(ic)) {
+        ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+    }
 }
 
-void ChewingEngine::filterKey(const InputMethodEntry & /*entry*/,
+void ChewingEngine::filterKey(const InputMethodEntry &entry,
                               KeyEvent &keyEvent) {
     if (keyEvent.isRelease()) {
         return;
     }
     auto *ic = keyEvent.inputContext();
+    if (isPassthrough(ic)) {
+        return;
+    }
+    selectContext(entry.uniqueName());
+    CHEWING_PROBE1(filter_key_entry, keyEvent.key().sym());
     if (ic->inputPanel().candidateList() &&
         (keyEvent.key().isSimple() || keyEvent.key().isCursorMove() ||
          keyEvent.key().check(FcitxKey_space, KeyState::Shift) ||
          keyEvent.key().check(FcitxKey_Tab) ||
          keyEvent.key().check(FcitxKey_Return, KeyState::Shift))) {
         keyEvent.filterAndAccept();
+        CHEWING_PROBE1(filter_key_return, 1);
         return;
     }
 
-    if (!ic->inputPanel().candidateList()) {
+    if (!ic->inputPanel().candidateList() &&
+        state_ != ChewingCompositionState::Idle) {
         // Check if this key will produce something, if so, flush
         if (!keyEvent.key().hasModifier() &&
             Key::keySymToUnicode(keyEvent.key().sym())) {
             flushBuffer(keyEvent);
         }
     }
+    CHEWING_PROBE1(filter_key_return, keyEvent.filtered() ? 1 : 0);
 }
 
-void ChewingEngine::updatePreeditImpl(InputContext *ic) {
+bool ChewingEngine::updatePreeditImpl(InputContext *ic) {
+    ChewingContext *ctx = context_;
+    ChewingPreeditState state{
+        safeChewing_buffer_String(ctx), safeChewing_bopomofo_String(ctx),
+        safeChewing_aux_String(ctx), chewing_cursor_Current(ctx),
+        ic->capabilityFlags().test(CapabilityFlag::Preedit)};
+    if (state.aux.empty()) {
+        state.aux = reverseLookup_;
+    }
+    // Nothing observable changed, do not send the same preedit again.
+    // An empty panel means someone else has reset it.
+    if (lastPreeditIC_.get() == ic && state == lastPreedit_ &&
+        (state.empty() || !ic->inputPanel().empty())) {
+        return false;
+    }
+    lastPreeditIC_ = ic->watch();
+    lastPreedit_ = state;
+
     ic->inputPanel().setClientPreedit(Text());
     ic->inputPanel().setPreedit(Text());
     ic->inputPanel().setAuxDown(Text());
+    if (!state.aux.empty()) {
+        uiBytes_ += state.aux.size();
+        ic->inputPanel().setAuxDown(Text(std::move(state.aux)));
+    }
 
-    ChewingContext *ctx = context_.get();
-    std::string buffer = safeChewing_buffer_String(ctx);
-    std::string_view text = buffer;
-    std::string zuin = safeChewing_bopomofo_String(ctx);
-
-    CHEWING_DEBUG() << "Text: " << text << " Zuin: " << zuin;
+    std::string_view text = state.buffer;
+    CHEWING_DEBUG() << "Text: " << text << " Zuin: " << state.zuin;
 
     /* there is nothing */
-    if (zuin.empty() && text.empty()) {
-        return;
+    if (state.buffer.empty() && state.zuin.empty()) {
+        return true;
     }
 
     auto len = utf8::lengthValidated(text);
     if (len == utf8::INVALID_LENGTH) {
-        return;
+        return true;
     }
-    const auto useClientPreedit =
-        ic->capabilityFlags().test(CapabilityFlag::Preedit);
+    const auto useClientPreedit = state.clientPreedit;
     const auto format =
         useClientPreedit ? TextFormatFlag::Underline : TextFormatFlag::NoFlag;
     Text preedit;
 
-    int cur = chewing_cursor_Current(ctx);
+    int cur = state.cursor;
     int rcur = text.size();
     if (cur >= 0 && static_cast<size_t>(cur) < len) {
         rcur = utf8::ncharByteLength(text.begin(), cur);
     }
     preedit.setCursor(rcur);
 
+    uiBytes_ += state.buffer.size() + state.zuin.size();
     // insert zuin in the middle
     preedit.append(std::string(text.substr(0, rcur)), format);
-    preedit.append(std::move(zuin), {TextFormatFlag::HighLight, format});
+    preedit.append(std::move(state.zuin), {TextFormatFlag::HighLight, format});
     preedit.append(std::string(text.substr(rcur)), format);
 
-    if (auto aux = safeChewing_aux_String(ctx); !aux.empty()) {
-        ic->inputPanel().setAuxDown(Text(std::move(aux)));
-    }
-
     if (useClientPreedit) {
         ic->inputPanel().setClientPreedit(preedit);
     } else {
         ic->inputPanel().setPreedit(preedit);
     }
+    return true;
 }
 
-void ChewingEngine::updatePreedit(InputContext *ic) {
-    updatePreeditImpl(ic);
-    ic->updatePreedit();
+bool ChewingEngine::updatePreedit(InputContext *ic) {
+    const bool changed = updatePreeditImpl(ic);
+    if (changed) {
+        ic->updatePreedit();
+    }
+    updateState();
+    return changed;
+}
+
+void ChewingEngine::updateState() {
+    ChewingContext *ctx = context_;
+    if (chewing_cand_TotalPage(ctx) > 0) {
+        state_ = ChewingCompositionState::Selecting;
+    } else if (chewing_buffer_Check(ctx) || chewing_bopomofo_Check(ctx)) {
+        state_ = ChewingCompositionState::Composing;
+    } else {
+        state_ = ChewingCompositionState::Idle;
+        composedInput_.clear();
+        composedInputOverflow_ = false;
+    }
 }
 
 void ChewingEngine::updateUI(InputContext *ic) {
     CHEWING_DEBUG() << "updateUI";
-    // clean up window asap
-    ic->inputPanel().reset();
-    ic->inputPanel().setCandidateList(
-        std::make_unique<ChewingCandidateList>(this, ic));
-    if (ic->inputPanel().candidateList()->empty()) {
-        ic->inputPanel().setCandidateList(nullptr);
+    const auto start = ChewingTraceWriter::clock::now();
+    CHEWING_PROBE1(update_ui_entry, chewing_buffer_Len(context_));
+    auto &inputPanel = ic->inputPanel();
+    const auto bytesBefore = uiBytes_;
+    bool changed = false;
+    int candidateCount = 0;
+    // Refill the list that is already shown instead of creating a new one,
+    // the rest of the panel is rewritten by updatePreedit.
+    if (auto candidateList = std::dynamic_pointer_cast<ChewingCandidateList>(
+            inputPanel.candidateList())) {
+        changed = candidateList->fillCandidate();
+        candidateCount = candidateList->size();
+        if (changed) {
+            uiBytes_ += candidateList->bytes();
+        }
+        if (candidateCount == 0) {
+            inputPanel.setCandidateList(nullptr);
+        }
+    } else {
+        auto newList = std::make_unique<ChewingCandidateList>(this, ic);
+        candidateCount = newList->size();
+        if (candidateCount != 0) {
+            uiBytes_ += newList->bytes();
+            inputPanel.setCandidateList(std::move(newList));
+            changed = true;
+        } else if (inputPanel.candidateList()) {
+            inputPanel.setCandidateList(nullptr);
+            changed = true;
+        }
     }
 
-    updatePreedit(ic);
-    ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+    if (updatePreedit(ic)) {
+        changed = true;
+    }
+    if (changed) {
+        ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+    }
+    CHEWING_DEBUG() << "Sent " << (uiBytes_ - bytesBefore)
+                    << " bytes to frontend, total " << uiBytes_;
+    CHEWING_PROBE2(update_ui_return, candidateCount, uiBytes_ - bytesBefore);
+    updateUITime_ += ChewingTraceWriter::clock::now() - start;
+}
+
+int ChewingEngine::maxPreeditLength() const {
+    if (degradation_ >= 1) {
+        return std::max(4, *config_.MaxPreeditLength / 2);
+    }
+    return *config_.MaxPreeditLength;
+}
+
+void ChewingEngine::setDegradation(int level) {
+    if (level == degradation_) {
+        return;
+    }
+    CHEWING_WARN() << "Change degradation level from " << degradation_
+                   << " to " << level;
+    degradation_ = level;
+    for (const auto &[_, ctx] : contexts_) {
+        chewing_set_maxChiSymbolLen(ctx.get(), maxPreeditLength());
+    }
+}
+
+ChewingPageFaults ChewingEngine::pageFaults() const {
+    // Skip the system call when nothing reports the page faults.
+    if (!CHEWING_PROBE_ENABLED(page_faults) &&
+        !chewing_log().checkLogLevel(Debug) &&
+        *config_.SlowEventThreshold <= 0) {
+        return {};
+    }
+    return currentPageFaults();
+}
+
+void ChewingEngine::checkLatency(InputContext *ic, std::string_view what,
+                                 ChewingTraceWriter::clock::time_point start,
+                                 ChewingPageFaults faultsBefore) {
+    const auto updateUITime = std::exchange(updateUITime_, {});
+    const auto libchewingTime = std::exchange(libchewingTime_, {});
+    const auto faultsAfter = pageFaults();
+    const auto majorFaults = faultsAfter.major - faultsBefore.major;
+    const auto minorFaults = faultsAfter.minor - faultsBefore.minor;
+    CHEWING_DEBUG() << "Page faults of " << what << " event: " << majorFaults
+                    << " major, " << minorFaults << " minor";
+    CHEWING_PROBE2(page_faults, majorFaults, minorFaults);
+    const auto threshold = *config_.SlowEventThreshold;
+    if (threshold <= 0) {
+        return;
+    }
+    const auto elapsed = ChewingTraceWriter::clock::now() - start;
+    if (elapsed < std::chrono::milliseconds(threshold)) {
+        slowEvents_ = 0;
+        if (degradation_ > 0 && ++fastEvents_ >= FAST_EVENTS_TO_RECOVER) {
+            fastEvents_ = 0;
+            setDegradation(degradation_ - 1);
+        }
+        return;
+    }
+
+    auto *ctx = context_;
+    auto toUs = [](ChewingTraceWriter::clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+            .count();
+    };
+    CHEWING_WARN() << "Slow " << what << " event: total " << toUs(elapsed)
+                   << "us, libchewing " << toUs(libchewingTime)
+                   << "us, update ui " << toUs(updateUITime)
+                   << "us, buffer length " << chewing_buffer_Len(ctx)
+                   << ", candidates " << chewing_cand_TotalChoice(ctx)
+                   << ", layout "
+                   << builtin_keymaps[static_cast<int>(layout(entry_))]
+                   << ", page faults " << majorFaults << " major "
+                   << minorFaults << " minor, degradation " << degradation_;
+    CHEWING_PROBE2(slow_event, toUs(elapsed), degradation_);
+
+    fastEvents_ = 0;
+    if (++slowEvents_ >= SLOW_EVENTS_TO_DEGRADE && degradation_ < 2) {
+        slowEvents_ = 0;
+        setDegradation(degradation_ + 1);
+    }
+    // Do not let a slow composition grow any further.
+    if (degradation_ >= 2 && state_ != ChewingCompositionState::Idle) {
+        chewing_cand_close(ctx);
+        saveReading();
+        if (chewing_buffer_Check(ctx) &&
+            chewing_commit_preedit_buf(ctx) == 0) {
+            commitText(ic);
+            if (trace_) {
+                trace_->writeEvent(ChewingTraceRecordType::ForcedCommit,
+                                   ChewingTraceWriter::clock::now());
+            }
+        }
+        chewing_clean_bopomofo_buf(ctx);
+        updateUI(ic);
+        showPrediction(ic);
+    }
 }
 
 void ChewingEngine::flushBuffer(InputContextEvent &event) {
-    auto *ctx = context_.get();
+    auto *ctx = context_;
+    CHEWING_PROBE1(flush_buffer_entry, chewing_buffer_Len(ctx));
     std::string text;
     if (*config_.switchInputMethodBehavior ==
             SwitchInputMethodBehavior::CommitPreedit ||
@@ -687,6 +1765,7 @@ void ChewingEngine::flushBuffer(InputContextEvent &event) {
         event.inputContext()->commitString(text);
     }
     doReset(event);
+    CHEWING_PROBE1(flush_buffer_return, text.size());
 }
 
 } // namespace fcitx
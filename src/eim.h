@@ -7,16 +7,22 @@
 #ifndef _FCITX5_CHEWING_EIM_H_
 #define _FCITX5_CHEWING_EIM_H_
 
+#include "prediction.h"
+#include "trace.h"
 #include <chewing.h>
 #include <cstddef>
+#include <cstdint>
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/enum.h>
 #include <fcitx-config/iniparser.h>
 #include <fcitx-config/option.h>
 #include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/event.h>
+#include <fcitx-utils/eventdispatcher.h>
 #include <fcitx-utils/i18n.h>
 #include <fcitx-utils/misc.h>
 #include <fcitx-utils/trackableobject.h>
+#include <fcitx-utils/unixfd.h>
 #include <fcitx/addonfactory.h>
 #include <fcitx/addoninstance.h>
 #include <fcitx/addonmanager.h>
@@ -26,7 +32,13 @@
 #include <fcitx/inputmethodengine.h>
 #include <fcitx/instance.h>
 #include <fcitx/text.h>
+#include <chrono>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace fcitx {
@@ -109,6 +121,9 @@ public:
 
     void dumpDescription(RawConfig &config) const override {
         Base::dumpDescription(config);
+        config.setValueByPath(
+            "Tooltip", _("Not used by Chewing (Hsu) and Chewing (Hanyu "
+                         "Pinyin), which have a fixed layout."));
         config.remove("Enum");
         for (size_t i = 0; i < supportedLayouts_.size(); i++) {
             config.setValueByPath("Enum/" + std::to_string(i),
@@ -174,8 +189,75 @@ FCITX_CONFIGURATION(
                                  _("Enable easy symbol"), false};
     Option<bool> SpaceAsSelection{this, "SpaceAsSelection",
                                   _("Space as selection key"), true};
+    // Once the preedit grows past this length, libchewing commits the
+    // leading phrase, so the part being converted stays bounded. 39 is
+    // MAX_CHI_SYMBOL_LEN of libchewing.
+    Option<int, IntConstrain> MaxPreeditLength{
+        this, "MaxPreeditLength", _("Maximum length of preedit"), 18,
+        IntConstrain(4, 39)};
     ChewingLayoutOption Layout{this, "Layout", _("Keyboard Layout"),
-                               ChewingLayout::Default};);
+                               ChewingLayout::Default};
+    Option<bool> RecordTrace{this, "RecordTrace",
+                             _("Record key events to a trace file"), false};
+    Option<bool> ReverseLookup{this, "ReverseLookup",
+                               _("Show bopomofo of committed text"), false};
+    // Repeated slow events make the engine shrink the preedit and then commit
+    // it, until events are fast again. 0 disables the check.
+    Option<int, IntConstrain> SlowEventThreshold{
+        this, "SlowEventThreshold",
+        _("Slow event threshold in milliseconds (0 to disable)"), 100,
+        IntConstrain(0, 10000)};
+    Option<bool> RestoreComposition{this, "RestoreComposition",
+                                    _("Restore composition after restart"),
+                                    true};
+    // Dictionary and user phrase files are read into page cache on focus in,
+    // so the first key does not wait for them.
+    Option<int, IntConstrain> WarmUpBudget{
+        this, "WarmUpBudget",
+        _("Dictionary prefetch size in MiB (0 to disable)"), 64,
+        IntConstrain(0, 1024)};
+    // Phrases that followed the last commits before are shown after a
+    // commit, and chosen with Alt and the selection key.
+    Option<bool> Prediction{this, "Prediction",
+                            _("Predict the next phrase after commit"),
+                            false};);
+
+enum class ChewingCompositionState {
+    // Nothing is being composed, libchewing has nothing to do with the key.
+    Idle,
+    // Preedit buffer or bopomofo is not empty.
+    Composing,
+    // Candidate window is open.
+    Selecting,
+};
+
+// What is shown by updatePreedit, used to skip sending unchanged preedit.
+struct ChewingPreeditState {
+    std::string buffer;
+    std::string zuin;
+    std::string aux;
+    int cursor = 0;
+    bool clientPreedit = false;
+
+    bool empty() const {
+        return buffer.empty() && zuin.empty() && aux.empty();
+    }
+    bool operator==(const ChewingPreeditState &other) const = default;
+};
+
+struct ChewingPageFaults {
+    long major = 0;
+    long minor = 0;
+};
+
+// Input given to libchewing since the composition started. Saved on exit and
+// replayed after restart to restore the composition.
+struct ChewingComposedInput {
+    ChewingTraceRecordType type;
+    Key key;
+    // Candidate index for Select, -1 or 1 for Page.
+    int index = 0;
+};
 
 class ChewingEngine final : public InputMethodEngine {
 public:
@@ -188,8 +270,7 @@ public:
     void deactivate(const InputMethodEntry &entry,
                     InputContextEvent &event) override;
     void keyEvent(const InputMethodEntry &entry, KeyEvent &keyEvent) override;
-    void filterKey(const InputMethodEntry & /*entry*/,
-                   KeyEvent & /*event*/) override;
+    void filterKey(const InputMethodEntry &entry, KeyEvent &event) override;
     void reloadConfig() override;
     void reset(const InputMethodEntry &entry,
                InputContextEvent &event) override;
@@ -203,25 +284,140 @@ public:
     }
 
     void updateUI(InputContext *ic);
-    void updatePreedit(InputContext *ic);
+    // Return false if nothing is changed.
+    bool updatePreedit(InputContext *ic);
     Text getPreedit(InputContext *ic);
 
     void flushBuffer(InputContextEvent &event);
     void doReset(InputContextEvent &event);
 
-    ChewingContext *context() { return context_.get(); }
+    // Remember the phones of the buffer before libchewing handles a key, so
+    // the reading of the text it commits can be shown afterwards.
+    void saveReading();
+    void lookupReading(std::string_view commit);
+    // Commit the text libchewing has committed, after the reverse lookup and
+    // learning from it.
+    void commitText(InputContext *ic);
+
+    // Learn the committed text for prediction. The phrases following it are
+    // shown by showPrediction once nothing is being composed.
+    void learnPhrase(InputContext *ic, std::string_view commit);
+    // Return true if the prediction is shown.
+    bool showPrediction(InputContext *ic);
+    void selectPrediction(InputContext *ic, std::string phrase);
+
+    // Page faults of the current thread so far, or zero when they are not
+    // reported.
+    ChewingPageFaults pageFaults() const;
+    // Called after a key event or a candidate selection that started at
+    // start, to log and degrade on slow events.
+    void checkLatency(InputContext *ic, std::string_view what,
+                      ChewingTraceWriter::clock::time_point start,
+                      ChewingPageFaults faultsBefore);
+
+    // True while handling a key, candidate selection and paging done by the
+    // key are not recorded separately.
+    bool handlingKey() const { return handlingKey_; }
+    void recordInput(const ChewingComposedInput &input);
+    // Replaying the composition saved before restart.
+    bool restoring() const { return restoring_; }
+
+    ChewingContext *context() { return context_; }
+    ChewingCompositionState state() const { return state_; }
+    ChewingTraceWriter *trace() { return trace_.get(); }
+    // Bytes of preedit, aux and candidate text sent to the frontend.
+    uint64_t uiBytes() const { return uiBytes_; }
+    // Time spent in libchewing handling the current event.
+    void addLibchewingTime(ChewingTraceWriter::clock::duration time) {
+        libchewingTime_ += time;
+    }
 
 private:
+    void keyEventImpl(KeyEvent &keyEvent);
     bool handleCandidateKeyEvent(const KeyEvent &keyEvent) const;
-    void updatePreeditImpl(InputContext *ic);
+    bool handlePredictionKeyEvent(const KeyEvent &keyEvent);
+    bool updatePreeditImpl(InputContext *ic);
+    void updateState();
 
     FCITX_ADDON_DEPENDENCY_LOADER(chttrans, instance_->addonManager());
 
     void populateConfig();
+    void setupContext(ChewingContext *ctx);
+    void configureContext(ChewingContext *ctx, ChewingLayout layout);
+    // Layout used by the input method entry.
+    ChewingLayout layout(std::string_view entry) const;
+    // Make the context of the entry current, creating it on first use.
+    void selectContext(const std::string &entry);
+    int maxPreeditLength() const;
+    static std::filesystem::path compositionFile();
+    static std::filesystem::path predictionFile();
+    void saveComposition();
+    void removeComposition();
+    void restoreComposition();
+    // 0: normal, 1: smaller preedit, 2: also commit preedit on slow events.
+    void setDegradation(int level);
+
+    void watchDictionary();
+    void scheduleReloadDictionary();
+    void reloadDictionary();
+    void warmUpDictionary();
+    void swapContext();
+
     Instance *instance_;
     ChewingConfig config_;
-    UniqueCPtr<ChewingContext, chewing_delete> context_;
+    // Contexts of each input method entry, by unique name.
+    std::unordered_map<std::string, UniqueCPtr<ChewingContext, chewing_delete>>
+        contexts_;
+    std::string entry_;
+    ChewingContext *context_ = nullptr;
     TrackableObjectReference<InputContext> ic_;
+    ChewingCompositionState state_ = ChewingCompositionState::Idle;
+    std::unique_ptr<ChewingTraceWriter> trace_;
+    TrackableObjectReference<InputContext> lastPreeditIC_;
+    ChewingPreeditState lastPreedit_;
+    uint64_t uiBytes_ = 0;
+    size_t readingLength_ = 0;
+    std::vector<unsigned short> readingPhones_;
+    std::string reverseLookup_;
+    // Stage timings of the current event, for the slow event log.
+    ChewingTraceWriter::clock::duration updateUITime_{};
+    ChewingTraceWriter::clock::duration libchewingTime_{};
+    int slowEvents_ = 0;
+    int fastEvents_ = 0;
+    int degradation_ = 0;
+    bool handlingKey_ = false;
+    std::vector<ChewingComposedInput> composedInput_;
+    bool composedInputOverflow_ = false;
+    bool compositionRestoreChecked_ = false;
+    std::unique_ptr<EventSource> compositionRestoreEvent_;
+    // The composition file holds the current composition, it is removed
+    // once the composition is committed or cleared.
+    bool compositionSaved_ = false;
+    bool restoring_ = false;
+    std::unique_ptr<ChewingPredictor> predictor_;
+    bool predictNext_ = false;
+
+    // Dictionary hot reload. A new context is built by dictionaryLoader_,
+    // handed back through dispatcher_ and swapped in when nothing is being
+    // composed.
+    EventDispatcher dispatcher_;
+    UnixFD dictionaryWatchFD_;
+    std::unique_ptr<EventSourceIO> dictionaryWatcher_;
+    std::unique_ptr<EventSourceTime> dictionaryReloadTimer_;
+    std::thread dictionaryLoader_;
+    bool reloadDictionaryAgain_ = false;
+    std::unordered_map<std::string, UniqueCPtr<ChewingContext, chewing_delete>>
+        loadedContexts_;
+    std::unordered_map<std::string, UniqueCPtr<ChewingContext, chewing_delete>>
+        pendingContexts_;
+
+    // Prefetch of the dictionary files and creation of the contexts of other
+    // entries, see warmUpDictionary. warmedContexts_ is filled by
+    // warmUpThread_ and taken on the main thread once it is joined.
+    std::thread warmUpThread_;
+    std::optional<std::chrono::steady_clock::time_point> lastWarmUp_;
+    std::unordered_map<std::string, UniqueCPtr<ChewingContext, chewing_delete>>
+        warmedContexts_;
 };
 
 class ChewingEngineFactory : public AddonFactory {
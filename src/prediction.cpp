@@ -0,0 +1,356 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "prediction.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcitx-utils/misc.h>
+#include <fcitx-utils/unixfd.h>
+#include <fcitx-utils/utf8.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fcitx {
+
+namespace {
+
+// Longer commits are not predicted, only their tail is used as context.
+constexpr size_t MAX_PHRASE_LENGTH = 8;
+constexpr size_t MAX_PHRASES_PER_CONTEXT = 16;
+// Keeps the file around a few MiB at most.
+constexpr size_t MAX_ENTRIES = 65536;
+// Learned phrases kept in memory before they are merged into the file.
+constexpr size_t MERGE_THRESHOLD = 64;
+// Two phrases of context are worth more than one.
+constexpr uint64_t TRIGRAM_WEIGHT = 4;
+
+constexpr size_t HEADER_SIZE =
+    sizeof(ChewingPredictionMagic) + sizeof(uint32_t) * 2;
+static_assert(HEADER_SIZE % alignof(ChewingPredictionEntry) == 0);
+
+uint64_t fnv1a(uint64_t hash, std::string_view str) {
+    for (const char c : str) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Contexts of one and two phrases use a different prefix, so they never
+// hash the same text.
+uint64_t contextHash(std::string_view last) {
+    return fnv1a(fnv1a(14695981039346656037ULL, "1"), last);
+}
+
+uint64_t contextHash(std::string_view previous, std::string_view last) {
+    auto hash = fnv1a(fnv1a(14695981039346656037ULL, "2"), previous);
+    return fnv1a(fnv1a(hash, std::string_view("\0", 1)), last);
+}
+
+void addCount(uint32_t &count, uint64_t value) {
+    count = static_cast<uint32_t>(
+        std::min<uint64_t>(UINT32_MAX, count + value));
+}
+
+} // namespace
+
+ChewingPredictor::ChewingPredictor(std::filesystem::path path)
+    : path_(std::move(path)) {
+    map();
+}
+
+ChewingPredictor::~ChewingPredictor() {
+    sync();
+    unmap();
+}
+
+void ChewingPredictor::map() {
+    UnixFD fd = UnixFD::own(open(path_.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (!fd.isValid() || fstat(fd.fd(), &st) != 0 ||
+        static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+        return;
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.fd(), 0);
+    if (data == MAP_FAILED) {
+        return;
+    }
+    data_ = static_cast<const char *>(data);
+    size_ = size;
+
+    uint32_t count;
+    uint32_t poolSize;
+    std::memcpy(&count, data_ + sizeof(ChewingPredictionMagic),
+                sizeof(count));
+    std::memcpy(&poolSize,
+                data_ + sizeof(ChewingPredictionMagic) + sizeof(count),
+                sizeof(poolSize));
+    if (std::memcmp(data_, ChewingPredictionMagic,
+                    sizeof(ChewingPredictionMagic)) != 0 ||
+        size != HEADER_SIZE + (count * sizeof(ChewingPredictionEntry)) +
+                    poolSize) {
+        unmap();
+        return;
+    }
+    entries_ = reinterpret_cast<const ChewingPredictionEntry *>(
+        data_ + HEADER_SIZE);
+    entryCount_ = count;
+    pool_ = data_ + HEADER_SIZE + (count * sizeof(ChewingPredictionEntry));
+    poolSize_ = poolSize;
+}
+
+void ChewingPredictor::unmap() {
+    if (data_) {
+        munmap(const_cast<char *>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    entries_ = nullptr;
+    entryCount_ = 0;
+    pool_ = nullptr;
+    poolSize_ = 0;
+}
+
+void ChewingPredictor::learn(std::string_view phrase) {
+    finishMerge(false);
+    const auto length = utf8::lengthValidated(phrase);
+    if (length == utf8::INVALID_LENGTH || length == 0) {
+        resetHistory();
+        return;
+    }
+    if (length <= MAX_PHRASE_LENGTH && !previous_[1].empty()) {
+        pending_[contextHash(previous_[1])][std::string(phrase)]++;
+        if (!previous_[0].empty()) {
+            pending_[contextHash(previous_[0], previous_[1])]
+                    [std::string(phrase)]++;
+        }
+        pendingCount_++;
+    }
+    if (length > MAX_PHRASE_LENGTH) {
+        phrase = phrase.substr(utf8::ncharByteLength(
+            phrase.begin(), length - MAX_PHRASE_LENGTH));
+    }
+    previous_[0] = std::move(previous_[1]);
+    previous_[1] = phrase;
+    if (pendingCount_ >= MERGE_THRESHOLD) {
+        startMerge();
+    }
+}
+
+void ChewingPredictor::resetHistory() {
+    previous_[0].clear();
+    previous_[1].clear();
+}
+
+std::vector<std::string> ChewingPredictor::predict(size_t limit) {
+    finishMerge(false);
+    if (previous_[1].empty() || limit == 0) {
+        return {};
+    }
+    std::unordered_map<std::string, uint64_t> scores;
+    addCounts(scores, contextHash(previous_[1]), 1);
+    if (!previous_[0].empty()) {
+        addCounts(scores, contextHash(previous_[0], previous_[1]),
+                  TRIGRAM_WEIGHT);
+    }
+    std::vector<std::pair<std::string, uint64_t>> sorted(scores.begin(),
+                                                         scores.end());
+    limit = std::min(limit, sorted.size());
+    std::partial_sort(sorted.begin(), sorted.begin() + limit, sorted.end(),
+                      [](const auto &lhs, const auto &rhs) {
+                          if (lhs.second != rhs.second) {
+                              return lhs.second > rhs.second;
+                          }
+                          return lhs.first < rhs.first;
+                      });
+    std::vector<std::string> result;
+    result.reserve(limit);
+    for (size_t i = 0; i < limit; i++) {
+        result.push_back(std::move(sorted[i].first));
+    }
+    return result;
+}
+
+void ChewingPredictor::addCounts(
+    std::unordered_map<std::string, uint64_t> &scores, uint64_t context,
+    uint64_t weight) const {
+    auto [begin, end] =
+        std::ranges::equal_range(entries_, entries_ + entryCount_, context,
+                                 std::less{}, &ChewingPredictionEntry::context);
+    for (const auto *entry = begin; entry != end; ++entry) {
+        if (static_cast<size_t>(entry->offset) + entry->length > poolSize_) {
+            continue;
+        }
+        scores[std::string(pool_ + entry->offset, entry->length)] +=
+            weight * entry->count;
+    }
+    for (const auto *counts : {&merging_, &pending_}) {
+        if (auto iter = counts->find(context); iter != counts->end()) {
+            for (const auto &[phrase, count] : iter->second) {
+                scores[phrase] += weight * count;
+            }
+        }
+    }
+}
+
+void ChewingPredictor::sync() {
+    finishMerge(true);
+    if (pendingCount_ == 0) {
+        return;
+    }
+    startMerge();
+    finishMerge(true);
+}
+
+void ChewingPredictor::startMerge() {
+    // Try again on a later commit.
+    if (mergeThread_.joinable()) {
+        return;
+    }
+    merging_ = std::move(pending_);
+    pending_.clear();
+    pendingCount_ = 0;
+    merged_ = false;
+    mergeThread_ = std::thread([this]() {
+        merge();
+        merged_ = true;
+    });
+}
+
+void ChewingPredictor::finishMerge(bool wait) {
+    if (!mergeThread_.joinable() || (!wait && !merged_)) {
+        return;
+    }
+    mergeThread_.join();
+    merging_.clear();
+    unmap();
+    map();
+}
+
+void ChewingPredictor::merge() const {
+    Counts counts;
+    for (size_t i = 0; i < entryCount_; i++) {
+        const auto &entry = entries_[i];
+        if (static_cast<size_t>(entry.offset) + entry.length > poolSize_) {
+            continue;
+        }
+        addCount(counts[entry.context]
+                       [std::string(pool_ + entry.offset, entry.length)],
+                 entry.count);
+    }
+    for (const auto &[context, phrases] : merging_) {
+        for (const auto &[phrase, count] : phrases) {
+            addCount(counts[context][phrase], count);
+        }
+    }
+
+    struct Phrase {
+        uint64_t context;
+        uint32_t count;
+        std::string_view text;
+    };
+    auto byCount = [](const Phrase &lhs, const Phrase &rhs) {
+        if (lhs.count != rhs.count) {
+            return lhs.count > rhs.count;
+        }
+        return lhs.text < rhs.text;
+    };
+    std::vector<Phrase> phrases;
+    std::vector<Phrase> contextPhrases;
+    for (const auto &[context, texts] : counts) {
+        contextPhrases.clear();
+        for (const auto &[text, count] : texts) {
+            contextPhrases.push_back({context, count, text});
+        }
+        if (contextPhrases.size() > MAX_PHRASES_PER_CONTEXT) {
+            std::ranges::partial_sort(contextPhrases,
+                                      contextPhrases.begin() +
+                                          MAX_PHRASES_PER_CONTEXT,
+                                      byCount);
+            contextPhrases.resize(MAX_PHRASES_PER_CONTEXT);
+        }
+        phrases.insert(phrases.end(), contextPhrases.begin(),
+                       contextPhrases.end());
+    }
+    // Drop the rarest phrases and age the rest, so the file stays bounded
+    // and old habits fade out.
+    if (phrases.size() > MAX_ENTRIES) {
+        std::ranges::partial_sort(phrases, phrases.begin() + MAX_ENTRIES,
+                                  byCount);
+        phrases.resize(MAX_ENTRIES);
+        for (auto &phrase : phrases) {
+            phrase.count = std::max<uint32_t>(1, phrase.count / 2);
+        }
+    }
+    std::ranges::sort(phrases, [&byCount](const Phrase &lhs,
+                                          const Phrase &rhs) {
+        if (lhs.context != rhs.context) {
+            return lhs.context < rhs.context;
+        }
+        return byCount(lhs, rhs);
+    });
+
+    std::vector<ChewingPredictionEntry> entries;
+    entries.reserve(phrases.size());
+    std::string pool;
+    for (const auto &phrase : phrases) {
+        entries.push_back({phrase.context, phrase.count,
+                           static_cast<uint32_t>(pool.size()),
+                           static_cast<uint32_t>(phrase.text.size())});
+        pool.append(phrase.text);
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(path_.parent_path(), ec);
+    if (ec) {
+        return;
+    }
+    auto tempPath = path_;
+    tempPath += ".tmp";
+    {
+        // The phrases are what the user typed, keep them private.
+        UnixFD fd = UnixFD::own(open(tempPath.c_str(),
+                                     O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,
+                                     0600));
+        if (!fd.isValid() || fchmod(fd.fd(), 0600) != 0) {
+            return;
+        }
+        UniqueFilePtr file{fdopen(fd.fd(), "wb")};
+        if (!file) {
+            return;
+        }
+        fd.release();
+        const auto count = static_cast<uint32_t>(entries.size());
+        const auto poolSize = static_cast<uint32_t>(pool.size());
+        fwrite(ChewingPredictionMagic, 1, sizeof(ChewingPredictionMagic),
+               file.get());
+        fwrite(&count, sizeof(count), 1, file.get());
+        fwrite(&poolSize, sizeof(poolSize), 1, file.get());
+        fwrite(entries.data(), sizeof(ChewingPredictionEntry), entries.size(),
+               file.get());
+        fwrite(pool.data(), 1, pool.size(), file.get());
+        if (fflush(file.get()) != 0 || ferror(file.get())) {
+            file.reset();
+            std::filesystem::remove(tempPath, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tempPath, path_, ec);
+}
+
+} // namespace fcitx
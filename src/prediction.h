@@ -0,0 +1,100 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_CHEWING_PREDICTION_H_
+#define _FCITX5_CHEWING_PREDICTION_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fcitx {
+
+// A prediction file starts with ChewingPredictionMagic, followed by
+//   uint32_t entry count, uint32_t string pool size,
+// the entries sorted by context and then by descending count, and the string
+// pool holding the predicted phrases. Integers are stored in host byte order.
+inline constexpr char ChewingPredictionMagic[8] = {'F', 'C', 'H', 'W',
+                                                   'P', 'R', 'D', '1'};
+
+struct ChewingPredictionEntry {
+    // Hash of the one or two phrases committed before.
+    uint64_t context;
+    uint32_t count;
+    // Phrase in the string pool.
+    uint32_t offset;
+    uint32_t length;
+    uint32_t reserved = 0;
+};
+
+// Phrases that followed the last one or two committed phrases, learned from
+// the committed text.
+//
+// The learned counts live in a file that is memory mapped for lookup. New
+// commits are counted in memory and merged into the file by a background
+// thread, the file is mapped again once the merge is done.
+class ChewingPredictor {
+public:
+    explicit ChewingPredictor(std::filesystem::path path);
+    ~ChewingPredictor();
+
+    ChewingPredictor(const ChewingPredictor &) = delete;
+    ChewingPredictor &operator=(const ChewingPredictor &) = delete;
+
+    const std::filesystem::path &path() const { return path_; }
+
+    // Count phrase as following the previous commits, and make it the last
+    // commit.
+    void learn(std::string_view phrase);
+    // Forget the previous commits, e.g. when the focus changes.
+    void resetHistory();
+    // Return at most limit phrases likely to follow the previous commits,
+    // most likely first.
+    std::vector<std::string> predict(size_t limit);
+    // Merge the phrases learned so far into the file and wait for it.
+    void sync();
+
+private:
+    using Counts =
+        std::unordered_map<uint64_t,
+                           std::unordered_map<std::string, uint32_t>>;
+
+    void map();
+    void unmap();
+    void startMerge();
+    // Finish a merge started before, if wait is false only when it is done.
+    void finishMerge(bool wait);
+    void merge() const;
+    void addCounts(std::unordered_map<std::string, uint64_t> &scores,
+                   uint64_t context, uint64_t weight) const;
+
+    std::filesystem::path path_;
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    const ChewingPredictionEntry *entries_ = nullptr;
+    size_t entryCount_ = 0;
+    const char *pool_ = nullptr;
+    size_t poolSize_ = 0;
+
+    // The last two commits, previous_[1] is the latest.
+    std::string previous_[2];
+    Counts pending_;
+    size_t pendingCount_ = 0;
+    // Counts being merged by mergeThread_, only read until it is joined.
+    Counts merging_;
+    std::thread mergeThread_;
+    std::atomic<bool> merged_ = false;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_CHEWING_PREDICTION_H_
@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_CHEWING_PROBE_H_
+#define _FCITX5_CHEWING_PROBE_H_
+
+// Static tracepoints of provider fcitx5_chewing, usable from bpftrace, perf
+// or systemtap, e.g.
+//   bpftrace -e 'usdt:/usr/lib/fcitx5/libchewing.so:key_event_return
+//                { @[arg1] = count(); }'
+// Each probe has a semaphore that is raised while something is attached to
+// it. The probe and its arguments, which may query libchewing, are skipped
+// unless it is raised.
+#ifdef HAVE_SYS_SDT_H
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define CHEWING_PROBE_SEMAPHORE(name)                                          \
+    __extension__ inline unsigned short fcitx5_chewing_##name##_semaphore     \
+        __attribute__((unused)) __attribute__((section(".probes")))            \
+        __attribute__((visibility("hidden"))) = 0
+
+CHEWING_PROBE_SEMAPHORE(key_event_entry);
+CHEWING_PROBE_SEMAPHORE(key_event_return);
+CHEWING_PROBE_SEMAPHORE(filter_key_entry);
+CHEWING_PROBE_SEMAPHORE(filter_key_return);
+CHEWING_PROBE_SEMAPHORE(handle_entry);
+CHEWING_PROBE_SEMAPHORE(handle_return);
+CHEWING_PROBE_SEMAPHORE(select_entry);
+CHEWING_PROBE_SEMAPHORE(select_return);
+CHEWING_PROBE_SEMAPHORE(fill_candidate_entry);
+CHEWING_PROBE_SEMAPHORE(fill_candidate_return);
+CHEWING_PROBE_SEMAPHORE(update_ui_entry);
+CHEWING_PROBE_SEMAPHORE(update_ui_return);
+CHEWING_PROBE_SEMAPHORE(flush_buffer_entry);
+CHEWING_PROBE_SEMAPHORE(flush_buffer_return);
+CHEWING_PROBE_SEMAPHORE(page_faults);
+CHEWING_PROBE_SEMAPHORE(slow_event);
+
+#define CHEWING_PROBE_ENABLED(name)                                            \
+    __builtin_expect(fcitx5_chewing_##name##_semaphore, 0)
+#define CHEWING_PROBE(name)                                                    \
+    do {                                                                       \
+        if (CHEWING_PROBE_ENABLED(name)) {                                     \
+            DTRACE_PROBE(fcitx5_chewing, name);                                \
+        }                                                                      \
+    } while (0)
+#define CHEWING_PROBE1(name, a)                                                \
+    do {                                                                       \
+        if (CHEWING_PROBE_ENABLED(name)) {                                     \
+            DTRACE_PROBE1(fcitx5_chewing, name, a);                            \
+        }                                                                      \
+    } while (0)
+#define CHEWING_PROBE2(name, a, b)                                             \
+    do {                                                                       \
+        if (CHEWING_PROBE_ENABLED(name)) {                                     \
+            DTRACE_PROBE2(fcitx5_chewing, name, a, b);                         \
+        }                                                                      \
+    } while (0)
+#define CHEWING_PROBE3(name, a, b, c)                                          \
+    do {                                                                       \
+        if (CHEWING_PROBE_ENABLED(name)) {                                     \
+            DTRACE_PROBE3(fcitx5_chewing, name, a, b, c);                      \
+        }                                                                      \
+    } while (0)
+#else
+#define CHEWING_PROBE_ENABLED(name) false
+#define CHEWING_PROBE(name)                                                    \
+    do {                                                                       \
+    } while (0)
+#define CHEWING_PROBE1(name, a) CHEWING_PROBE(name)
+#define CHEWING_PROBE2(name, a, b) CHEWING_PROBE(name)
+#define CHEWING_PROBE3(name, a, b, c) CHEWING_PROBE(name)
+#endif
+
+#endif // _FCITX5_CHEWING_PROBE_H_
@@ -0,0 +1,263 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#include "trace.h"
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/misc.h>
+#include <fcitx-utils/standardpaths.h>
+#include <fcitx-utils/unixfd.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace fcitx {
+
+namespace {
+
+template <typename T>
+void writeValue(FILE *file, T value) {
+    fwrite(&value, sizeof(value), 1, file);
+}
+
+template <typename T>
+bool readValue(FILE *file, T &value) {
+    return fread(&value, sizeof(value), 1, file) == 1;
+}
+
+void writeString(FILE *file, std::string_view str) {
+    const auto len = static_cast<uint16_t>(
+        std::min<size_t>(str.size(), UINT16_MAX));
+    writeValue(file, len);
+    fwrite(str.data(), 1, len, file);
+}
+
+bool readString(FILE *file, std::string &str) {
+    uint16_t len;
+    if (!readValue(file, len)) {
+        return false;
+    }
+    str.resize(len);
+    return fread(str.data(), 1, len, file) == len;
+}
+
+} // namespace
+
+ChewingTraceWriter::ChewingTraceWriter(UniqueFilePtr file,
+                                       std::filesystem::path path)
+    : file_(std::move(file)), path_(std::move(path)), start_(clock::now()) {
+    fwrite(ChewingTraceMagic, 1, sizeof(ChewingTraceMagic), file_.get());
+}
+
+std::unique_ptr<ChewingTraceWriter> ChewingTraceWriter::create() {
+    auto dir =
+        StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+        "chewing";
+    // File names sort by creation time.
+    std::vector<std::filesystem::path> traces;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+        const auto name = entry.path().filename().string();
+        if (name.starts_with("trace-") && name.ends_with(".bin")) {
+            traces.push_back(entry.path());
+        }
+    }
+    if (traces.size() >= MaxTraceFiles) {
+        std::ranges::sort(traces);
+        for (size_t i = 0; i + MaxTraceFiles <= traces.size(); i++) {
+            std::filesystem::remove(traces[i], ec);
+        }
+    }
+    return create(dir /
+                  ("trace-" + std::to_string(time(nullptr)) + ".bin"));
+}
+
+std::unique_ptr<ChewingTraceWriter>
+ChewingTraceWriter::create(const std::filesystem::path &path) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    if (ec) {
+        return nullptr;
+    }
+    UnixFD fd = UnixFD::own(
+        open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600));
+    // An existing file may have been created with a wider mode.
+    if (!fd.isValid() || fchmod(fd.fd(), 0600) != 0) {
+        return nullptr;
+    }
+    UniqueFilePtr file{fdopen(fd.fd(), "wb")};
+    if (!file) {
+        return nullptr;
+    }
+    fd.release();
+    return std::make_unique<ChewingTraceWriter>(std::move(file), path);
+}
+
+void ChewingTraceWriter::writeHeader(ChewingTraceRecordType type,
+                                     clock::time_point start) {
+    const auto now = clock::now();
+    writeValue(file_.get(), static_cast<uint8_t>(type));
+    writeValue(file_.get(),
+               static_cast<uint64_t>(
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       start - start_)
+                       .count()));
+    writeValue(file_.get(),
+               static_cast<uint32_t>(
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       now - start)
+                       .count()));
+}
+
+void ChewingTraceWriter::writeKey(clock::time_point start, const Key &key,
+                                  bool filtered) {
+    writeHeader(ChewingTraceRecordType::Key, start);
+    writeValue(file_.get(), static_cast<uint32_t>(key.sym()));
+    writeValue(file_.get(), static_cast<uint32_t>(key.states()));
+    writeValue(file_.get(), static_cast<uint8_t>(filtered ? 1 : 0));
+}
+
+void ChewingTraceWriter::writeSelect(clock::time_point start, int index) {
+    writeHeader(ChewingTraceRecordType::Select, start);
+    writeValue(file_.get(), static_cast<int32_t>(index));
+}
+
+void ChewingTraceWriter::writePage(clock::time_point start, bool prev) {
+    writeHeader(ChewingTraceRecordType::Page, start);
+    writeValue(file_.get(), static_cast<uint8_t>(prev ? 1 : 0));
+}
+
+void ChewingTraceWriter::writeActivate(clock::time_point start,
+                                       std::string_view entry) {
+    writeHeader(ChewingTraceRecordType::Activate, start);
+    writeString(file_.get(), entry);
+}
+
+void ChewingTraceWriter::writeEvent(ChewingTraceRecordType type,
+                                    clock::time_point start) {
+    writeHeader(type, start);
+}
+
+void ChewingTraceWriter::writeConfig(const RawConfig &config) {
+    std::vector<std::pair<std::string, std::string>> items;
+    config.visitSubItems(
+        [&items](const RawConfig &item, const std::string &path) {
+            if (!item.hasSubItems()) {
+                items.emplace_back(path, item.value());
+            }
+            return true;
+        },
+        "", true);
+    writeHeader(ChewingTraceRecordType::Config, clock::now());
+    writeValue(file_.get(), static_cast<uint32_t>(items.size()));
+    for (const auto &[path, value] : items) {
+        writeString(file_.get(), path);
+        writeString(file_.get(), value);
+    }
+}
+
+void ChewingTraceWriter::flush() { fflush(file_.get()); }
+
+ChewingTraceReader::ChewingTraceReader(const std::filesystem::path &path)
+    : file_(fopen(path.c_str(), "rbe")) {
+    if (!file_) {
+        return;
+    }
+    char magic[sizeof(ChewingTraceMagic)];
+    valid_ = fread(magic, 1, sizeof(magic), file_.get()) == sizeof(magic) &&
+             memcmp(magic, ChewingTraceMagic, sizeof(magic)) == 0;
+}
+
+std::optional<ChewingTraceRecord> ChewingTraceReader::next() {
+    if (!valid_) {
+        return std::nullopt;
+    }
+    auto *file = file_.get();
+    uint8_t type;
+    uint64_t timestamp;
+    uint32_t engineTime;
+    if (!readValue(file, type) || !readValue(file, timestamp) ||
+        !readValue(file, engineTime)) {
+        return std::nullopt;
+    }
+    ChewingTraceRecord record;
+    record.type = static_cast<ChewingTraceRecordType>(type);
+    record.timestamp = std::chrono::microseconds(timestamp);
+    record.engineTime = std::chrono::microseconds(engineTime);
+    switch (record.type) {
+    case ChewingTraceRecordType::Key: {
+        uint32_t sym;
+        uint32_t states;
+        uint8_t filtered;
+        if (!readValue(file, sym) || !readValue(file, states) ||
+            !readValue(file, filtered)) {
+            return std::nullopt;
+        }
+        record.key = Key(static_cast<KeySym>(sym), KeyStates(states));
+        record.filtered = filtered;
+        break;
+    }
+    case ChewingTraceRecordType::Select: {
+        int32_t index;
+        if (!readValue(file, index)) {
+            return std::nullopt;
+        }
+        record.index = index;
+        break;
+    }
+    case ChewingTraceRecordType::Page: {
+        uint8_t prev;
+        if (!readValue(file, prev)) {
+            return std::nullopt;
+        }
+        record.index = prev ? -1 : 1;
+        break;
+    }
+    case ChewingTraceRecordType::Config: {
+        uint32_t count;
+        if (!readValue(file, count)) {
+            return std::nullopt;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            std::string path;
+            std::string value;
+            if (!readString(file, path) || !readString(file, value)) {
+                return std::nullopt;
+            }
+            record.config.setValueByPath(path, std::move(value));
+        }
+        break;
+    }
+    case ChewingTraceRecordType::Activate:
+        if (!readString(file, record.entry)) {
+            return std::nullopt;
+        }
+        break;
+    case ChewingTraceRecordType::Deactivate:
+    case ChewingTraceRecordType::Reset:
+    case ChewingTraceRecordType::ForcedCommit:
+        break;
+    default:
+        // Unknown record, the rest of file can not be parsed.
+        valid_ = false;
+        return std::nullopt;
+    }
+    return record;
+}
+
+} // namespace fcitx
@@ -0,0 +1,114 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ */
+#ifndef _FCITX5_CHEWING_TRACE_H_
+#define _FCITX5_CHEWING_TRACE_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/misc.h>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace fcitx {
+
+// A trace file starts with ChewingTraceMagic, followed by records of
+//   uint8_t type, uint64_t timestamp (us), uint32_t engine time (us)
+// and a type dependent payload:
+//   Key: uint32_t sym, uint32_t states, uint8_t filtered
+//   Select: int32_t index
+//   Page: uint8_t prev
+//   Activate: (uint16_t length, bytes) of the input method entry
+//   Config: uint32_t count, then count pairs of (uint16_t length, bytes) for
+//           path and value.
+// Integers are stored in host byte order. The files are only readable by the
+// user, since they hold everything typed.
+inline constexpr char ChewingTraceMagic[8] = {'F', 'C', 'H', 'W',
+                                              'T', 'R', 'C', '1'};
+
+enum class ChewingTraceRecordType : uint8_t {
+    Key = 1,
+    Select,
+    Activate,
+    Deactivate,
+    Reset,
+    Config,
+    // Candidate page changed without a key, e.g. by mouse.
+    Page,
+    // Preedit committed by the latency watchdog.
+    ForcedCommit,
+};
+
+struct ChewingTraceRecord {
+    ChewingTraceRecordType type;
+    // Since the start of the trace.
+    std::chrono::microseconds timestamp{0};
+    // Time spent inside the engine to handle the event.
+    std::chrono::microseconds engineTime{0};
+    Key key;
+    bool filtered = false;
+    // Candidate index for Select, -1 or 1 for Page.
+    int index = 0;
+    // Input method entry for Activate.
+    std::string entry;
+    RawConfig config;
+};
+
+class ChewingTraceWriter {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t MaxTraceFiles = 10;
+
+    ChewingTraceWriter(UniqueFilePtr file, std::filesystem::path path);
+
+    // Create a new trace file under the user data directory, and remove the
+    // oldest ones so only the last MaxTraceFiles are kept.
+    static std::unique_ptr<ChewingTraceWriter> create();
+    // Create or truncate the file at path.
+    static std::unique_ptr<ChewingTraceWriter>
+    create(const std::filesystem::path &path);
+
+    const std::filesystem::path &path() const { return path_; }
+
+    void writeKey(clock::time_point start, const Key &key, bool filtered);
+    void writeSelect(clock::time_point start, int index);
+    void writePage(clock::time_point start, bool prev);
+    void writeActivate(clock::time_point start, std::string_view entry);
+    void writeEvent(ChewingTraceRecordType type, clock::time_point start);
+    void writeConfig(const RawConfig &config);
+    void flush();
+
+private:
+    void writeHeader(ChewingTraceRecordType type, clock::time_point start);
+
+    UniqueFilePtr file_;
+    std::filesystem::path path_;
+    clock::time_point start_;
+};
+
+class ChewingTraceReader {
+public:
+    explicit ChewingTraceReader(const std::filesystem::path &path);
+
+    bool isValid() const { return valid_; }
+    // Return the next record, or nullopt at the end of file.
+    std::optional<ChewingTraceRecord> next();
+
+private:
+    UniqueFilePtr file_;
+    bool valid_ = false;
+};
+
+} // namespace fcitx
+
+#endif // _FCITX5_CHEWING_TRACE_H_
@@ -0,0 +1,221 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "testdir.h"
+#include "testfrontend_public.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/keysym.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/candidatelist.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputmethodgroup.h>
+#include <fcitx/inputmethodmanager.h>
+#include <fcitx/inputpanel.h>
+#include <fcitx/instance.h>
+#include <functional>
+#include <new>
+#include <string_view>
+
+// Counts the allocations done through the global operator new while a
+// measurement is running. libchewing itself allocates with malloc and is not
+// counted, this only covers the engine and the fcitx code it calls.
+namespace {
+
+struct AllocStats {
+    size_t count = 0;
+    size_t bytes = 0;
+};
+
+bool counting = false;
+AllocStats stats;
+
+void *countedAlloc(size_t size) {
+    if (counting) {
+        stats.count++;
+        stats.bytes += size;
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    if (void *ptr = std::malloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+void *operator new(size_t size) { return countedAlloc(size); }
+void *operator new[](size_t size) { return countedAlloc(size); }
+void *operator new(size_t size, const std::nothrow_t & /*unused*/) noexcept {
+    try {
+        return countedAlloc(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+    return operator new(size, tag);
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t /*unused*/) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t /*unused*/) noexcept {
+    std::free(ptr);
+}
+
+using namespace fcitx;
+
+namespace {
+
+// Budgets per single call. They include the allocations of the input context
+// and the test frontend around the engine, so they are not tight, but any new
+// allocation per candidate or per character will exceed them.
+constexpr AllocStats IdleKeyBudget{32, 4096};
+constexpr AllocStats ComposeKeyBudget{64, 8192};
+constexpr AllocStats OpenCandidateBudget{256, 32768};
+constexpr AllocStats PagingBudget{64, 8192};
+constexpr AllocStats SelectBudget{128, 16384};
+
+// Run the operation a few times and check the worst one, the first call may
+// populate the pooled candidate words.
+void measure(std::string_view name, const AllocStats &budget,
+             const std::function<void()> &prepare,
+             const std::function<void()> &operation) {
+    constexpr int Repeat = 3;
+    AllocStats worst;
+    for (int i = 0; i < Repeat; i++) {
+        prepare();
+        stats = AllocStats();
+        counting = true;
+        operation();
+        counting = false;
+        if (i == 0) {
+            continue;
+        }
+        worst.count = std::max(worst.count, stats.count);
+        worst.bytes = std::max(worst.bytes, stats.bytes);
+    }
+    FCITX_INFO() << name << ": " << worst.count << " allocations, "
+                 << worst.bytes << " bytes";
+    FCITX_ASSERT(worst.count <= budget.count)
+        << name << " exceeds allocation budget " << budget.count;
+    FCITX_ASSERT(worst.bytes <= budget.bytes)
+        << name << " exceeds byte budget " << budget.bytes;
+}
+
+void testAllocations(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        chewing->setConfig(config);
+        auto defaultGroup = instance->inputMethodManager().currentGroup();
+        defaultGroup.inputMethodList().clear();
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("keyboard-us"));
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("chewing"));
+        defaultGroup.setDefaultInputMethod("");
+        instance->inputMethodManager().setGroup(defaultGroup);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+        auto send = [testfrontend, &uuid](const Key &key) {
+            testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, key, false);
+        };
+        // The first Escape may only leave the candidate list.
+        auto clear = [&send]() {
+            send(Key(FcitxKey_Escape));
+            send(Key(FcitxKey_Escape));
+        };
+        // ㄈㄣ with its candidates shown.
+        auto openCandidates = [&send]() {
+            send(Key("z"));
+            send(Key("p"));
+            send(Key("space"));
+            send(Key("Down"));
+        };
+
+        measure("Idle key", IdleKeyBudget, clear,
+                [&send]() { send(Key(FcitxKey_Left)); });
+        measure(
+            "Compose key", ComposeKeyBudget,
+            [&send, &clear]() {
+                clear();
+                send(Key("z"));
+            },
+            [&send]() { send(Key("p")); });
+        measure(
+            "Open candidates", OpenCandidateBudget,
+            [&send, &clear]() {
+                clear();
+                send(Key("z"));
+                send(Key("p"));
+                send(Key("space"));
+            },
+            [&send]() { send(Key("Down")); });
+        measure(
+            "Paging", PagingBudget,
+            [&clear, &openCandidates]() {
+                clear();
+                openCandidates();
+            },
+            [ic]() {
+                auto candidateList = ic->inputPanel().candidateList();
+                FCITX_ASSERT(candidateList && candidateList->toPageable());
+                candidateList->toPageable()->next();
+            });
+        measure(
+            "Select", SelectBudget,
+            [&clear, &openCandidates]() {
+                clear();
+                openCandidates();
+            },
+            [ic]() {
+                auto candidateList = ic->inputPanel().candidateList();
+                FCITX_ASSERT(candidateList && !candidateList->empty());
+                candidateList->candidate(0).select(ic);
+            });
+        clear();
+
+        testfrontend->call<ITestFrontend::destroyInputContext>(uuid);
+    });
+}
+
+} // namespace
+
+int main() {
+    setupTestingEnvironment(TESTING_BINARY_DIR, {TESTING_BINARY_DIR "/src"},
+                            {TESTING_BINARY_DIR "/test"});
+    char arg0[] = "allocchewing";
+    char arg1[] = "--disable=all";
+    char arg2[] = "--enable=testim,testfrontend,chewing";
+    char *argv[] = {arg0, arg1, arg2};
+    Instance instance(FCITX_ARRAY_SIZE(argv), argv);
+    instance.addonManager().registerDefaultLoader(nullptr);
+
+    testAllocations(&instance);
+
+    instance.eventDispatcher().schedule([&instance]() { instance.exit(); });
+    instance.exec();
+
+    return 0;
+}
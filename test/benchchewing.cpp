@@ -0,0 +1,322 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#include "testdir.h"
+#include "testfrontend_public.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/keysym.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputmethodgroup.h>
+#include <fcitx/inputmethodmanager.h>
+#include <fcitx/inputpanel.h>
+#include <fcitx/instance.h>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <vector>
+
+using namespace fcitx;
+
+namespace {
+
+constexpr int Rounds = 2000;
+
+ICUUID setupChewing(Instance *instance) {
+    auto *chewing = instance->addonManager().addon("chewing", true);
+    FCITX_ASSERT(chewing);
+    RawConfig config;
+    config.setValueByPath("Layout", "Default Keyboard");
+    chewing->setConfig(config);
+    auto defaultGroup = instance->inputMethodManager().currentGroup();
+    defaultGroup.inputMethodList().clear();
+    defaultGroup.inputMethodList().push_back(
+        InputMethodGroupItem("keyboard-us"));
+    defaultGroup.inputMethodList().push_back(InputMethodGroupItem("chewing"));
+    defaultGroup.setDefaultInputMethod("");
+    instance->inputMethodManager().setGroup(defaultGroup);
+    auto *testfrontend = instance->addonManager().addon("testfrontend");
+    auto uuid =
+        testfrontend->call<ITestFrontend::createInputContext>("testapp");
+    auto *ic = instance->inputContextManager().findByUUID(uuid);
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("Control+space"), false));
+    FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+    return uuid;
+}
+
+void report(std::string_view name, size_t keys,
+            std::chrono::steady_clock::duration elapsed) {
+    auto ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    FCITX_INFO() << name << ": " << keys << " keys, " << (ns / keys)
+                 << " ns/key";
+}
+
+// Keys that reach the engine while nothing is being composed: English typed
+// with CapsLock, and editing, navigating or using shortcuts with chewing
+// enabled.
+void benchIdleKeys(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto uuid = setupChewing(instance);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        std::vector<Key> letters;
+        for (char c : std::string_view("TheQuickBrownFoxJumpsOverTheLazyDog")) {
+            letters.emplace_back(static_cast<KeySym>(c), KeyState::CapsLock);
+        }
+        const std::vector<Key> editKeys{
+            Key(FcitxKey_Return), Key(FcitxKey_BackSpace),
+            Key(FcitxKey_Left),   Key(FcitxKey_Right),
+            Key(FcitxKey_Home),   Key(FcitxKey_End),
+            Key(FcitxKey_Delete), Key("Control+c"),
+            Key("Control+v"),     Key("Shift+Left")};
+
+        auto run = [testfrontend, &uuid](std::string_view name,
+                                         const std::vector<Key> &keys) {
+            size_t count = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < Rounds; i++) {
+                for (const auto &key : keys) {
+                    testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, key,
+                                                                    false);
+                    count++;
+                }
+            }
+            report(name, count, std::chrono::steady_clock::now() - start);
+        };
+        run("Idle English letters", letters);
+        run("Idle editing keys", editKeys);
+        testfrontend->call<ITestFrontend::destroyInputContext>(uuid);
+    });
+}
+
+// One syllable plus commit, for comparison with the idle path.
+void benchComposeKeys(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto uuid = setupChewing(instance);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        const std::vector<Key> keys{Key("z"), Key("p"), Key("space"),
+                                    Key("Return")};
+
+        size_t count = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < Rounds; i++) {
+            for (const auto &key : keys) {
+                testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, key,
+                                                                false);
+                count++;
+            }
+        }
+        report("Compose keys", count,
+               std::chrono::steady_clock::now() - start);
+        testfrontend->call<ITestFrontend::destroyInputContext>(uuid);
+    });
+}
+
+// Cost of typing one more syllable with a preedit of the given length, with
+// the default and the largest preedit length.
+void benchSentenceLength(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        constexpr std::string_view syllables[] = {"ji3", "su3", "cp3",
+                                                  "g4",  "2k7", "5j/ "};
+        constexpr int SentenceRounds = 50;
+        auto uuid = setupChewing(instance);
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto type = [testfrontend, &uuid](std::string_view syllable) {
+            for (char c : syllable) {
+                testfrontend->call<ITestFrontend::sendKeyEvent>(
+                    uuid, Key(static_cast<KeySym>(c)), false);
+            }
+        };
+
+        for (int maxLength : {18, 39}) {
+            RawConfig config;
+            config.setValueByPath("Layout", "Default Keyboard");
+            config.setValueByPath("MaxPreeditLength",
+                                  std::to_string(maxLength));
+            chewing->setConfig(config);
+            for (int length : {1, 2, 4, 8, 12, 16, 20, 24, 30, 36}) {
+                size_t count = 0;
+                std::chrono::steady_clock::duration elapsed{};
+                for (int i = 0; i < SentenceRounds; i++) {
+                    for (int j = 0; j + 1 < length; j++) {
+                        type(syllables[j % std::size(syllables)]);
+                    }
+                    const auto last =
+                        syllables[(length - 1) % std::size(syllables)];
+                    auto start = std::chrono::steady_clock::now();
+                    type(last);
+                    elapsed += std::chrono::steady_clock::now() - start;
+                    count += last.size();
+                    testfrontend->call<ITestFrontend::sendKeyEvent>(
+                        uuid, Key(FcitxKey_Escape), false);
+                }
+                report("Max length " + std::to_string(maxLength) +
+                           ", sentence length " + std::to_string(length),
+                       count, elapsed);
+            }
+        }
+        testfrontend->call<ITestFrontend::destroyInputContext>(uuid);
+    });
+}
+
+// The usual way to pick a character or a phrase: type it, open the
+// candidates, select the second one and commit.
+void benchSelectCommit(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        constexpr std::string_view oneSyllable[] = {"ji3", "su3", "cp3", "g4",
+                                                    "2k7"};
+        constexpr std::string_view twoSyllables[] = {"ji3su3", "cp3g4",
+                                                     "2k7ji3"};
+        auto uuid = setupChewing(instance);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto send = [testfrontend, &uuid](const Key &key) {
+            testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, key, false);
+        };
+        auto run = [&send](std::string_view name, const auto &readings) {
+            size_t count = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < Rounds; i++) {
+                const auto reading = readings[i % std::size(readings)];
+                for (char c : reading) {
+                    send(Key(static_cast<KeySym>(c)));
+                }
+                send(Key(FcitxKey_Down));
+                send(Key("2"));
+                send(Key(FcitxKey_Return));
+                count += reading.size() + 3;
+            }
+            report(name, count, std::chrono::steady_clock::now() - start);
+        };
+        run("Select and commit one syllable", oneSyllable);
+        run("Select and commit two syllables", twoSyllables);
+        testfrontend->call<ITestFrontend::destroyInputContext>(uuid);
+    });
+}
+
+// Peak resident set size in KiB.
+long maxResidentKiB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Hundreds of input contexts sharing the engine, as on a terminal server.
+// Focus moves between them while they have partial compositions, some of them
+// switch input method to flush the preedit, and they are destroyed at the end.
+void benchManyInputContexts(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        constexpr int SwitchRounds = 20;
+        auto firstUUID = setupChewing(instance);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto &icManager = instance->inputContextManager();
+        auto send = [testfrontend](const ICUUID &uuid, const Key &key) {
+            testfrontend->call<ITestFrontend::sendKeyEvent>(uuid, key, false);
+        };
+
+        for (int count : {10, 100, 300, 600}) {
+            const long rssBefore = maxResidentKiB();
+            std::vector<ICUUID> uuids{firstUUID};
+            while (static_cast<int>(uuids.size()) < count) {
+                auto uuid =
+                    testfrontend->call<ITestFrontend::createInputContext>(
+                        "testapp");
+                send(uuid, Key("Control+space"));
+                uuids.push_back(uuid);
+            }
+
+            size_t keys = 0;
+            size_t switches = 0;
+            std::chrono::steady_clock::duration switchTime{};
+            auto start = std::chrono::steady_clock::now();
+            for (int round = 0; round < SwitchRounds; round++) {
+                for (size_t i = 0; i < uuids.size(); i++) {
+                    auto *ic = icManager.findByUUID(uuids[i]);
+                    auto switchStart = std::chrono::steady_clock::now();
+                    ic->focusIn();
+                    switchTime +=
+                        std::chrono::steady_clock::now() - switchStart;
+                    switches++;
+                    // Leave a partial composition behind.
+                    send(uuids[i], Key("z"));
+                    send(uuids[i], Key("p"));
+                    keys += 2;
+                    if ((i + round) % 4 == 0) {
+                        send(uuids[i], Key("space"));
+                        send(uuids[i], Key("Return"));
+                        keys += 2;
+                    } else if ((i + round) % 7 == 0) {
+                        // Flush according to SwitchInputMethodBehavior.
+                        send(uuids[i], Key("Control+space"));
+                        send(uuids[i], Key("Control+space"));
+                        keys += 2;
+                    }
+                    switchStart = std::chrono::steady_clock::now();
+                    ic->focusOut();
+                    switchTime +=
+                        std::chrono::steady_clock::now() - switchStart;
+                    switches++;
+                }
+            }
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            const auto ms =
+                std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+                    .count();
+            const auto switchNs =
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    switchTime)
+                    .count();
+            FCITX_INFO() << count << " input contexts: " << keys << " keys in "
+                         << ms << " ms, "
+                         << (switches * 1000 / std::max<int64_t>(ms, 1))
+                         << " switches/s, " << (switchNs / switches)
+                         << " ns/switch, max rss grows "
+                         << (maxResidentKiB() - rssBefore) << " KiB";
+
+            for (size_t i = 1; i < uuids.size(); i++) {
+                testfrontend->call<ITestFrontend::destroyInputContext>(
+                    uuids[i]);
+            }
+            icManager.findByUUID(firstUUID)->focusIn();
+        }
+        testfrontend->call<ITestFrontend::destroyInputContext>(firstUUID);
+    });
+}
+
+} // namespace
+
+int main() {
+    setupTestingEnvironment(TESTING_BINARY_DIR, {TESTING_BINARY_DIR "/src"},
+                            {TESTING_BINARY_DIR "/test"});
+    char arg0[] = "benchchewing";
+    char arg1[] = "--disable=all";
+    char arg2[] = "--enable=testim,testfrontend,chewing";
+    char *argv[] = {arg0, arg1, arg2};
+    Instance instance(FCITX_ARRAY_SIZE(argv), argv);
+    instance.addonManager().registerDefaultLoader(nullptr);
+
+    benchIdleKeys(&instance);
+    benchComposeKeys(&instance);
+    benchSentenceLength(&instance);
+    benchSelectCommit(&instance);
+    benchManyInputContexts(&instance);
+
+    instance.eventDispatcher().schedule([&instance]() { instance.exit(); });
+    instance.exec();
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+#ifndef _FCITX5_CHEWING_FAKECHEWING_CHEWING_H_
+#define _FCITX5_CHEWING_FAKECHEWING_CHEWING_H_
+
+// The part of the libchewing API used by the engine, implemented by
+// fakechewing with tiny fixed tables. See fakechewing.cpp.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ChewingContext ChewingContext;
+
+#define SYMBOL_MODE 0
+#define CHINESE_MODE 1
+
+typedef void (*ChewingLogger)(void *data, int level, const char *fmt, ...);
+
+ChewingContext *chewing_new(void);
+ChewingContext *chewing_new2(const char *syspath, const char *userpath,
+                             ChewingLogger logger, void *loggerdata);
+void chewing_delete(ChewingContext *ctx);
+void chewing_free(void *ptr);
+int chewing_Reset(ChewingContext *ctx);
+void chewing_set_logger(ChewingContext *ctx, ChewingLogger logger,
+                        void *data);
+
+int chewing_KBStr2Num(const char str[]);
+int chewing_set_KBType(ChewingContext *ctx, int kbtype);
+void chewing_set_ChiEngMode(ChewingContext *ctx, int mode);
+void chewing_set_candPerPage(ChewingContext *ctx, int n);
+int chewing_get_candPerPage(const ChewingContext *ctx);
+void chewing_set_maxChiSymbolLen(ChewingContext *ctx, int n);
+void chewing_set_selKey(ChewingContext *ctx, const int *selkeys, int len);
+void chewing_set_addPhraseDirection(ChewingContext *ctx, int direction);
+void chewing_set_spaceAsSelection(ChewingContext *ctx, int mode);
+void chewing_set_escCleanAllBuf(ChewingContext *ctx, int mode);
+void chewing_set_autoShiftCur(ChewingContext *ctx, int mode);
+void chewing_set_easySymbolInput(ChewingContext *ctx, int mode);
+void chewing_set_phraseChoiceRearward(ChewingContext *ctx, int mode);
+
+int chewing_handle_Space(ChewingContext *ctx);
+int chewing_handle_Esc(ChewingContext *ctx);
+int chewing_handle_Enter(ChewingContext *ctx);
+int chewing_handle_Del(ChewingContext *ctx);
+int chewing_handle_Backspace(ChewingContext *ctx);
+int chewing_handle_Tab(ChewingContext *ctx);
+int chewing_handle_ShiftLeft(ChewingContext *ctx);
+int chewing_handle_Left(ChewingContext *ctx);
+int chewing_handle_ShiftRight(ChewingContext *ctx);
+int chewing_handle_Right(ChewingContext *ctx);
+int chewing_handle_Up(ChewingContext *ctx);
+int chewing_handle_Home(ChewingContext *ctx);
+int chewing_handle_End(ChewingContext *ctx);
+int chewing_handle_PageUp(ChewingContext *ctx);
+int chewing_handle_PageDown(ChewingContext *ctx);
+int chewing_handle_Down(ChewingContext *ctx);
+int chewing_handle_ShiftSpace(ChewingContext *ctx);
+int chewing_handle_CtrlNum(ChewingContext *ctx, int key);
+int chewing_handle_Default(ChewingContext *ctx, int key);
+
+int chewing_commit_preedit_buf(ChewingContext *ctx);
+void chewing_ack(ChewingContext *ctx);
+int chewing_clean_preedit_buf(ChewingContext *ctx);
+int chewing_clean_bopomofo_buf(ChewingContext *ctx);
+
+int chewing_keystroke_CheckIgnore(const ChewingContext *ctx);
+int chewing_keystroke_CheckAbsorb(const ChewingContext *ctx);
+
+int chewing_commit_Check(const ChewingContext *ctx);
+const char *chewing_commit_String_static(const ChewingContext *ctx);
+int chewing_buffer_Check(const ChewingContext *ctx);
+int chewing_buffer_Len(const ChewingContext *ctx);
+const char *chewing_buffer_String_static(const ChewingContext *ctx);
+int chewing_bopomofo_Check(const ChewingContext *ctx);
+const char *chewing_bopomofo_String_static(const ChewingContext *ctx);
+int chewing_aux_Check(const ChewingContext *ctx);
+const char *chewing_aux_String_static(const ChewingContext *ctx);
+int chewing_cursor_Current(const ChewingContext *ctx);
+
+int chewing_cand_TotalPage(const ChewingContext *ctx);
+int chewing_cand_ChoicePerPage(const ChewingContext *ctx);
+int chewing_cand_TotalChoice(const ChewingContext *ctx);
+int chewing_cand_CurrentPage(const ChewingContext *ctx);
+int chewing_cand_close(ChewingContext *ctx);
+int chewing_cand_choose_by_index(ChewingContext *ctx, int index);
+const char *chewing_cand_string_by_index_static(ChewingContext *ctx,
+                                                int index);
+int chewing_cand_list_has_next(ChewingContext *ctx);
+int chewing_cand_list_has_prev(ChewingContext *ctx);
+
+unsigned short *chewing_get_phoneSeq(const ChewingContext *ctx);
+int chewing_get_phoneSeqLen(const ChewingContext *ctx);
+int chewing_phone_to_bopomofo(unsigned short phone, char *buf,
+                              unsigned short len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _FCITX5_CHEWING_FAKECHEWING_CHEWING_H_
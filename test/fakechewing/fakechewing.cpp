@@ -0,0 +1,629 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+
+// A deterministic stand-in for libchewing, selected with
+// -DCHEWING_TARGET=fakechewing. It only knows the default keyboard layout
+// and a handful of syllables, so benchmarks measure the engine and fcitx
+// instead of the dictionary. Syllables not in the table convert to their own
+// bopomofo.
+//
+// FAKECHEWING_DELAY_US adds a delay to every chewing_handle_* call and
+// FAKECHEWING_NEW_DELAY_US to context creation, to simulate a slow backend.
+#include "chewing.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Bopomofo of the default layout, grouped as libchewing encodes a phone:
+// initial << 9 | medial << 7 | final << 3 | tone.
+constexpr std::array<std::string_view, 21> initials{
+    "ㄅ", "ㄆ", "ㄇ", "ㄈ", "ㄉ", "ㄊ", "ㄋ", "ㄌ", "ㄍ", "ㄎ", "ㄏ",
+    "ㄐ", "ㄑ", "ㄒ", "ㄓ", "ㄔ", "ㄕ", "ㄖ", "ㄗ", "ㄘ", "ㄙ"};
+constexpr std::array<std::string_view, 3> medials{"ㄧ", "ㄨ", "ㄩ"};
+constexpr std::array<std::string_view, 13> finals{
+    "ㄚ", "ㄛ", "ㄜ", "ㄝ", "ㄞ", "ㄟ", "ㄠ", "ㄡ", "ㄢ", "ㄣ", "ㄤ", "ㄥ", "ㄦ"};
+constexpr std::array<std::string_view, 5> tones{"", "ˊ", "ˇ", "ˋ", "˙"};
+
+constexpr std::string_view initialKeys = "1qaz2wsxedcrfv5tgbyhn";
+constexpr std::string_view medialKeys = "ujm";
+constexpr std::string_view finalKeys = "8ik,9ol.0p;/-";
+// Space is the first tone.
+constexpr std::string_view toneKeys = " 6347";
+
+struct Phrase {
+    std::string_view reading;
+    std::vector<std::string_view> candidates;
+};
+
+const std::vector<Phrase> &phrases() {
+    static const std::vector<Phrase> phrases{
+        {"ㄈㄣ",
+         {"分", "芬", "紛", "氛", "吩", "酚", "汾", "棻", "玢", "雰", "帉"}},
+        {"ㄈㄣˇ", {"粉", "黺"}},
+        {"ㄈㄣˋ", {"份", "分", "憤", "奮", "糞", "忿", "僨", "瀵"}},
+        {"ㄓㄨㄥ", {"中", "鐘", "終", "忠", "鍾", "衷", "盅", "忪"}},
+        {"ㄨㄣˊ", {"文", "聞", "紋", "蚊", "雯", "玟", "汶"}},
+        {"ㄋㄧˇ", {"你", "妳", "擬", "旎", "祢"}},
+        {"ㄏㄠˇ", {"好", "郝"}},
+    };
+    return phrases;
+}
+
+int envInt(const char *name) {
+    const char *value = std::getenv(name);
+    return value ? std::atoi(value) : 0;
+}
+
+void delay(int us) {
+    if (us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+struct Character {
+    std::string text;
+    unsigned short phone = 0;
+};
+
+std::string reading(unsigned short phone) {
+    std::string result;
+    if (int initial = phone >> 9) {
+        result.append(initials[initial - 1]);
+    }
+    if (int medial = (phone >> 7) & 0x3) {
+        result.append(medials[medial - 1]);
+    }
+    if (int final = (phone >> 3) & 0xf) {
+        result.append(finals[final - 1]);
+    }
+    if (int tone = phone & 0x7) {
+        result.append(tones[tone - 1]);
+    }
+    return result;
+}
+
+std::vector<std::string> candidatesFor(unsigned short phone) {
+    const auto text = reading(phone);
+    for (const auto &phrase : phrases()) {
+        if (phrase.reading == text) {
+            return {phrase.candidates.begin(), phrase.candidates.end()};
+        }
+    }
+    return {text};
+}
+
+} // namespace
+
+struct ChewingContext {
+    ChewingLogger logger = nullptr;
+    void *loggerData = nullptr;
+    int handleDelay = envInt("FAKECHEWING_DELAY_US");
+
+    int candPerPage = 10;
+    int maxChiSymbolLen = 18;
+    std::vector<int> selKeys;
+    bool spaceAsSelection = true;
+    bool escCleanAllBuf = false;
+    bool easySymbolInput = false;
+
+    std::vector<Character> buffer;
+    size_t cursor = 0;
+    // initial, medial, final
+    std::array<int, 3> bopomofo{};
+
+    bool candOpen = false;
+    size_t candIndex = 0;
+    std::vector<std::string> candidates;
+    int candPage = 0;
+
+    bool ignore = false;
+    bool absorb = false;
+    bool commit = false;
+    std::string commitString;
+    mutable std::string bufferString;
+    mutable std::string bopomofoString;
+
+    int pageCount() const {
+        return candidates.empty() ? 0
+                                  : (static_cast<int>(candidates.size()) +
+                                     candPerPage - 1) /
+                                        candPerPage;
+    }
+
+    bool bopomofoEmpty() const {
+        return bopomofo == std::array<int, 3>{};
+    }
+
+    bool empty() const { return buffer.empty() && bopomofoEmpty(); }
+
+    // Start a key, the result is ignored if nothing is being composed.
+    bool begin() {
+        delay(handleDelay);
+        commit = false;
+        ignore = empty();
+        absorb = !ignore;
+        return !ignore;
+    }
+
+    void doCommit(size_t length) {
+        commitString.clear();
+        for (size_t i = 0; i < length; i++) {
+            commitString.append(buffer[i].text);
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + length);
+        cursor = cursor > length ? cursor - length : 0;
+        commit = true;
+    }
+
+    void insert(Character character) {
+        buffer.insert(buffer.begin() + cursor, std::move(character));
+        cursor++;
+        if (buffer.size() > static_cast<size_t>(maxChiSymbolLen)) {
+            doCommit(1);
+        }
+    }
+
+    void finishSyllable(int tone) {
+        const unsigned short phone =
+            (bopomofo[0] << 9) | (bopomofo[1] << 7) | (bopomofo[2] << 3) |
+            tone;
+        bopomofo = {};
+        insert({candidatesFor(phone).front(), phone});
+    }
+
+    void openCandidates() {
+        candIndex = cursor < buffer.size() ? cursor : buffer.size() - 1;
+        const auto &character = buffer[candIndex];
+        candidates = character.phone ? candidatesFor(character.phone)
+                                     : std::vector<std::string>{
+                                           character.text};
+        candOpen = true;
+        candPage = 0;
+    }
+
+    void closeCandidates() {
+        candOpen = false;
+        candidates.clear();
+        candPage = 0;
+    }
+
+    void movePage(int delta) {
+        const int total = pageCount();
+        candPage = (candPage + delta + total) % total;
+    }
+};
+
+extern "C" {
+
+ChewingContext *chewing_new() {
+    delay(envInt("FAKECHEWING_NEW_DELAY_US"));
+    return new ChewingContext;
+}
+
+ChewingContext *chewing_new2(const char * /*syspath*/,
+                             const char * /*userpath*/, ChewingLogger logger,
+                             void *loggerdata) {
+    auto *ctx = chewing_new();
+    ctx->logger = logger;
+    ctx->loggerData = loggerdata;
+    return ctx;
+}
+
+void chewing_delete(ChewingContext *ctx) { delete ctx; }
+
+void chewing_free(void *ptr) { std::free(ptr); }
+
+int chewing_Reset(ChewingContext *ctx) {
+    ctx->closeCandidates();
+    ctx->buffer.clear();
+    ctx->cursor = 0;
+    ctx->bopomofo = {};
+    ctx->commit = false;
+    return 0;
+}
+
+void chewing_set_logger(ChewingContext *ctx, ChewingLogger logger,
+                        void *data) {
+    ctx->logger = logger;
+    ctx->loggerData = data;
+}
+
+int chewing_KBStr2Num(const char str[]) {
+    // Only the default layout is implemented, but keep the layouts distinct
+    // so the engine sees them as supported.
+    return static_cast<int>(std::hash<std::string_view>()(str) % 1000003);
+}
+
+int chewing_set_KBType(ChewingContext * /*ctx*/, int /*kbtype*/) { return 0; }
+void chewing_set_ChiEngMode(ChewingContext * /*ctx*/, int /*mode*/) {}
+void chewing_set_candPerPage(ChewingContext *ctx, int n) {
+    ctx->candPerPage = std::max(1, n);
+}
+int chewing_get_candPerPage(const ChewingContext *ctx) {
+    return ctx->candPerPage;
+}
+void chewing_set_maxChiSymbolLen(ChewingContext *ctx, int n) {
+    ctx->maxChiSymbolLen = n;
+}
+void chewing_set_selKey(ChewingContext *ctx, const int *selkeys, int len) {
+    ctx->selKeys.assign(selkeys, selkeys + len);
+}
+void chewing_set_addPhraseDirection(ChewingContext * /*ctx*/,
+                                    int /*direction*/) {}
+void chewing_set_spaceAsSelection(ChewingContext *ctx, int mode) {
+    ctx->spaceAsSelection = mode;
+}
+void chewing_set_escCleanAllBuf(ChewingContext *ctx, int mode) {
+    ctx->escCleanAllBuf = mode;
+}
+void chewing_set_autoShiftCur(ChewingContext * /*ctx*/, int /*mode*/) {}
+void chewing_set_easySymbolInput(ChewingContext *ctx, int mode) {
+    ctx->easySymbolInput = mode;
+}
+void chewing_set_phraseChoiceRearward(ChewingContext * /*ctx*/,
+                                      int /*mode*/) {}
+
+int chewing_handle_Space(ChewingContext *ctx) {
+    if (!ctx->begin()) {
+        return 0;
+    }
+    if (ctx->candOpen) {
+        ctx->movePage(1);
+    } else if (!ctx->bopomofoEmpty()) {
+        ctx->finishSyllable(1);
+    } else if (ctx->spaceAsSelection) {
+        ctx->openCandidates();
+    } else {
+        ctx->insert({" ", 0});
+    }
+    return 0;
+}
+
+int chewing_handle_Esc(ChewingContext *ctx) {
+    if (!ctx->begin()) {
+        return 0;
+    }
+    if (ctx->candOpen) {
+        ctx->closeCandidates();
+    } else if (ctx->escCleanAllBuf) {
+        chewing_Reset(ctx);
+    } else {
+        ctx->bopomofo = {};
+    }
+    return 0;
+}
+
+int chewing_handle_Enter(ChewingContext *ctx) {
+    if (!ctx->begin()) {
+        return 0;
+    }
+    if (ctx->candOpen) {
+        ctx->closeCandidates();
+        return 0;
+    }
+    ctx->bopomofo = {};
+    ctx->doCommit(ctx->buffer.size());
+    return 0;
+}
+
+int chewing_handle_Del(ChewingContext *ctx) {
+    if (!ctx->begin() || ctx->candOpen) {
+        return 0;
+    }
+    if (ctx->cursor < ctx->buffer.size()) {
+        ctx->buffer.erase(ctx->buffer.begin() + ctx->cursor);
+    }
+    return 0;
+}
+
+int chewing_handle_Backspace(ChewingContext *ctx) {
+    if (!ctx->begin() || ctx->candOpen) {
+        return 0;
+    }
+    auto &bopomofo = ctx->bopomofo;
+    if (!ctx->bopomofoEmpty()) {
+        for (auto iter = bopomofo.rbegin(); iter != bopomofo.rend(); ++iter) {
+            if (*iter) {
+                *iter = 0;
+                break;
+            }
+        }
+    } else if (ctx->cursor > 0) {
+        ctx->buffer.erase(ctx->buffer.begin() + ctx->cursor - 1);
+        ctx->cursor--;
+    }
+    return 0;
+}
+
+int chewing_handle_Tab(ChewingContext *ctx) {
+    ctx->begin();
+    return 0;
+}
+
+int chewing_handle_ShiftLeft(ChewingContext *ctx) {
+    ctx->begin();
+    return 0;
+}
+
+int chewing_handle_Left(ChewingContext *ctx) {
+    if (!ctx->begin()) {
+        return 0;
+    }
+    if (ctx->candOpen) {
+        ctx->movePage(-1);
+    } else if (ctx->cursor > 0) {
+        ctx->cursor--;
+    }
+    return 0;
+}
+
+int chewing_handle_ShiftRight(ChewingContext *ctx) {
+    ctx->begin();
+    return 0;
+}
+
+int chewing_handle_Right(ChewingContext *ctx) {
+    if (!ctx->begin()) {
+        return 0;
+    }
+    if (ctx->candOpen) {
+        ctx->movePage(1);
+    } else if (ctx->cursor < ctx->buffer.size()) {
+        ctx->cursor++;
+    }
+    return 0;
+}
+
+int chewing_handle_Up(ChewingContext *ctx) {
+    if (ctx->begin()) {
+        ctx->closeCandidates();
+    }
+    return 0;
+}
+
+int chewing_handle_Home(ChewingContext *ctx) {
+    if (ctx->begin() && !ctx->candOpen) {
+        ctx->cursor = 0;
+    }
+    return 0;
+}
+
+int chewing_handle_End(ChewingContext *ctx) {
+    if (ctx->begin() && !ctx->candOpen) {
+        ctx->cursor = ctx->buffer.size();
+    }
+    return 0;
+}
+
+int chewing_handle_PageUp(ChewingContext *ctx) {
+    if (ctx->begin() && ctx->candOpen) {
+        ctx->movePage(-1);
+    }
+    return 0;
+}
+
+int chewing_handle_PageDown(ChewingContext *ctx) {
+    if (ctx->begin() && ctx->candOpen) {
+        ctx->movePage(1);
+    }
+    return 0;
+}
+
+int chewing_handle_Down(ChewingContext *ctx) {
+    if (!ctx->begin() || !ctx->bopomofoEmpty() || ctx->buffer.empty()) {
+        return 0;
+    }
+    if (ctx->candOpen) {
+        // There is only one candidate list, go back to its first page.
+        ctx->candPage = 0;
+    } else {
+        ctx->openCandidates();
+    }
+    return 0;
+}
+
+int chewing_handle_ShiftSpace(ChewingContext *ctx) {
+    ctx->begin();
+    return 0;
+}
+
+int chewing_handle_CtrlNum(ChewingContext *ctx, int /*key*/) {
+    ctx->begin();
+    return 0;
+}
+
+int chewing_handle_Default(ChewingContext *ctx, int key) {
+    ctx->begin();
+    if (ctx->candOpen) {
+        ctx->absorb = true;
+        auto iter = std::find(ctx->selKeys.begin(), ctx->selKeys.end(), key);
+        if (iter == ctx->selKeys.end()) {
+            return 0;
+        }
+        const size_t index = (ctx->candPage * ctx->candPerPage) +
+                             (iter - ctx->selKeys.begin());
+        if (index < ctx->candidates.size()) {
+            ctx->buffer[ctx->candIndex].text = ctx->candidates[index];
+            ctx->closeCandidates();
+        }
+        return 0;
+    }
+
+    const char c = static_cast<char>(key);
+    auto &bopomofo = ctx->bopomofo;
+    if (auto pos = initialKeys.find(c); pos != std::string_view::npos) {
+        bopomofo = {static_cast<int>(pos) + 1, 0, 0};
+    } else if (pos = medialKeys.find(c); pos != std::string_view::npos) {
+        bopomofo[1] = static_cast<int>(pos) + 1;
+        bopomofo[2] = 0;
+    } else if (pos = finalKeys.find(c); pos != std::string_view::npos) {
+        bopomofo[2] = static_cast<int>(pos) + 1;
+    } else if (pos = toneKeys.find(c);
+               pos != std::string_view::npos && !ctx->bopomofoEmpty()) {
+        ctx->finishSyllable(static_cast<int>(pos) + 1);
+    } else if (!ctx->empty() && key > ' ' && key < 0x7f) {
+        ctx->insert({std::string(1, c), 0});
+    } else {
+        ctx->ignore = ctx->empty();
+        ctx->absorb = !ctx->ignore;
+        return 0;
+    }
+    ctx->ignore = false;
+    ctx->absorb = true;
+    return 0;
+}
+
+int chewing_commit_preedit_buf(ChewingContext *ctx) {
+    if (ctx->buffer.empty()) {
+        return -1;
+    }
+    ctx->closeCandidates();
+    ctx->doCommit(ctx->buffer.size());
+    return 0;
+}
+
+void chewing_ack(ChewingContext *ctx) {
+    ctx->commit = false;
+    ctx->commitString.clear();
+}
+
+int chewing_clean_preedit_buf(ChewingContext *ctx) {
+    ctx->buffer.clear();
+    ctx->cursor = 0;
+    return 0;
+}
+
+int chewing_clean_bopomofo_buf(ChewingContext *ctx) {
+    ctx->bopomofo = {};
+    return 0;
+}
+
+int chewing_keystroke_CheckIgnore(const ChewingContext *ctx) {
+    return ctx->ignore;
+}
+int chewing_keystroke_CheckAbsorb(const ChewingContext *ctx) {
+    return ctx->absorb;
+}
+
+int chewing_commit_Check(const ChewingContext *ctx) { return ctx->commit; }
+const char *chewing_commit_String_static(const ChewingContext *ctx) {
+    return ctx->commitString.c_str();
+}
+
+int chewing_buffer_Check(const ChewingContext *ctx) {
+    return !ctx->buffer.empty();
+}
+int chewing_buffer_Len(const ChewingContext *ctx) {
+    return static_cast<int>(ctx->buffer.size());
+}
+const char *chewing_buffer_String_static(const ChewingContext *ctx) {
+    ctx->bufferString.clear();
+    for (const auto &character : ctx->buffer) {
+        ctx->bufferString.append(character.text);
+    }
+    return ctx->bufferString.c_str();
+}
+
+int chewing_bopomofo_Check(const ChewingContext *ctx) {
+    return !ctx->bopomofoEmpty();
+}
+const char *chewing_bopomofo_String_static(const ChewingContext *ctx) {
+    const auto &bopomofo = ctx->bopomofo;
+    ctx->bopomofoString =
+        reading((bopomofo[0] << 9) | (bopomofo[1] << 7) | (bopomofo[2] << 3));
+    return ctx->bopomofoString.c_str();
+}
+
+int chewing_aux_Check(const ChewingContext * /*ctx*/) { return 0; }
+const char *chewing_aux_String_static(const ChewingContext * /*ctx*/) {
+    return "";
+}
+
+int chewing_cursor_Current(const ChewingContext *ctx) {
+    return static_cast<int>(ctx->cursor);
+}
+
+int chewing_cand_TotalPage(const ChewingContext *ctx) {
+    return ctx->candOpen ? ctx->pageCount() : 0;
+}
+int chewing_cand_ChoicePerPage(const ChewingContext *ctx) {
+    return ctx->candOpen ? ctx->candPerPage : 0;
+}
+int chewing_cand_TotalChoice(const ChewingContext *ctx) {
+    return static_cast<int>(ctx->candidates.size());
+}
+int chewing_cand_CurrentPage(const ChewingContext *ctx) {
+    return ctx->candPage;
+}
+int chewing_cand_close(ChewingContext *ctx) {
+    ctx->closeCandidates();
+    return 0;
+}
+int chewing_cand_choose_by_index(ChewingContext *ctx, int index) {
+    delay(ctx->handleDelay);
+    if (!ctx->candOpen || index < 0 ||
+        static_cast<size_t>(index) >= ctx->candidates.size()) {
+        return -1;
+    }
+    ctx->buffer[ctx->candIndex].text = ctx->candidates[index];
+    ctx->closeCandidates();
+    return 0;
+}
+const char *chewing_cand_string_by_index_static(ChewingContext *ctx,
+                                                int index) {
+    if (index < 0 || static_cast<size_t>(index) >= ctx->candidates.size()) {
+        return "";
+    }
+    return ctx->candidates[index].c_str();
+}
+int chewing_cand_list_has_next(ChewingContext * /*ctx*/) { return 0; }
+int chewing_cand_list_has_prev(ChewingContext * /*ctx*/) { return 0; }
+
+unsigned short *chewing_get_phoneSeq(const ChewingContext *ctx) {
+    auto *phones = static_cast<unsigned short *>(
+        std::malloc(sizeof(unsigned short) * (ctx->buffer.size() + 1)));
+    size_t length = 0;
+    for (const auto &character : ctx->buffer) {
+        if (character.phone) {
+            phones[length++] = character.phone;
+        }
+    }
+    return phones;
+}
+
+int chewing_get_phoneSeqLen(const ChewingContext *ctx) {
+    return static_cast<int>(
+        std::count_if(ctx->buffer.begin(), ctx->buffer.end(),
+                      [](const Character &c) { return c.phone != 0; }));
+}
+
+int chewing_phone_to_bopomofo(unsigned short phone, char *buf,
+                              unsigned short len) {
+    const auto text = reading(phone);
+    if (text.empty()) {
+        return -1;
+    }
+    if (buf) {
+        if (text.size() + 1 > len) {
+            return -1;
+        }
+        std::memcpy(buf, text.c_str(), text.size() + 1);
+    }
+    return static_cast<int>(text.size());
+}
+
+} // extern "C"
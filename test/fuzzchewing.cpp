@@ -0,0 +1,267 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+// Drive arbitrary key sequences through chewing and treat every event that
+// exceeds the latency budget as a finding.
+//
+// Each input byte is one action:
+//  - printable ASCII except upper case letters: the key itself.
+//  - 0x01 - 0x09: Control+1 - Control+9.
+//  - 'B' BackSpace, 'E' Return, 'H' Home, 'J' Down, 'K' Up, 'L' Shift+Left,
+//    'N' Right, 'P' Left, 'Q' Escape, 'R' Shift+Right, 'T' Tab,
+//    'U' Page_Up, 'D' Page_Down, 'W' Shift+space, 'X' Delete, 'Z' End.
+//  - 0x80 - 0xff: select candidate (byte % 10) of the current list.
+//
+// Built with ENABLE_FUZZER, this is a libFuzzer target and a slow event is a
+// crash. Otherwise it replays every file of the given corpus directories as a
+// regression test. Wall clock time is not reliable on a loaded machine, so
+// slow events only fail the replay when CHEWING_FUZZ_BUDGET_MS is set.
+#include "testdir.h"
+#include "testfrontend_public.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/keysym.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/candidatelist.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputmethodgroup.h>
+#include <fcitx/inputmethodmanager.h>
+#include <fcitx/inputpanel.h>
+#include <fcitx/instance.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace fcitx;
+
+namespace {
+
+constexpr int DefaultBudgetMs = 100;
+
+// Budget set explicitly through CHEWING_FUZZ_BUDGET_MS, if any.
+std::optional<std::chrono::milliseconds> explicitBudget() {
+    if (const char *env = getenv("CHEWING_FUZZ_BUDGET_MS")) {
+        if (int value = atoi(env); value > 0) {
+            return std::chrono::milliseconds(value);
+        }
+    }
+    return std::nullopt;
+}
+
+std::chrono::milliseconds budget() {
+    return explicitBudget().value_or(
+        std::chrono::milliseconds(DefaultBudgetMs));
+}
+
+std::optional<Key> actionToKey(uint8_t c) {
+    if (c >= 0x01 && c <= 0x09) {
+        return Key(static_cast<KeySym>('0' + c), KeyState::Ctrl);
+    }
+    switch (c) {
+    case 'B':
+        return Key(FcitxKey_BackSpace);
+    case 'E':
+        return Key(FcitxKey_Return);
+    case 'H':
+        return Key(FcitxKey_Home);
+    case 'J':
+        return Key(FcitxKey_Down);
+    case 'K':
+        return Key(FcitxKey_Up);
+    case 'L':
+        return Key(FcitxKey_Left, KeyState::Shift);
+    case 'N':
+        return Key(FcitxKey_Right);
+    case 'P':
+        return Key(FcitxKey_Left);
+    case 'Q':
+        return Key(FcitxKey_Escape);
+    case 'R':
+        return Key(FcitxKey_Right, KeyState::Shift);
+    case 'T':
+        return Key(FcitxKey_Tab);
+    case 'U':
+        return Key(FcitxKey_Page_Up);
+    case 'D':
+        return Key(FcitxKey_Page_Down);
+    case 'W':
+        return Key(FcitxKey_space, KeyState::Shift);
+    case 'X':
+        return Key(FcitxKey_Delete);
+    case 'Z':
+        return Key(FcitxKey_End);
+    default:
+        break;
+    }
+    if (c >= 0x20 && c < 0x7f && !(c >= 'A' && c <= 'Z')) {
+        return Key(static_cast<KeySym>(c));
+    }
+    return std::nullopt;
+}
+
+class KeySequenceRunner {
+public:
+    KeySequenceRunner(Instance *instance) : budget_(budget()) {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        chewing->setConfig(config);
+        auto defaultGroup = instance->inputMethodManager().currentGroup();
+        defaultGroup.inputMethodList().clear();
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("keyboard-us"));
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("chewing"));
+        defaultGroup.setDefaultInputMethod("");
+        instance->inputMethodManager().setGroup(defaultGroup);
+        testfrontend_ = instance->addonManager().addon("testfrontend");
+        uuid_ =
+            testfrontend_->call<ITestFrontend::createInputContext>("testapp");
+        ic_ = instance->inputContextManager().findByUUID(uuid_);
+        FCITX_ASSERT(testfrontend_->call<ITestFrontend::sendKeyEvent>(
+            uuid_, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic_) == "chewing");
+    }
+
+    // Return false if any event exceeds the budget.
+    bool run(std::string_view input) {
+        bool result = true;
+        for (size_t i = 0; i < input.size(); i++) {
+            const auto c = static_cast<uint8_t>(input[i]);
+            auto start = std::chrono::steady_clock::now();
+            if (c >= 0x80) {
+                // Hold a reference, select will replace the list.
+                auto candidateList = ic_->inputPanel().candidateList();
+                if (int index = c % 10;
+                    candidateList && index < candidateList->size()) {
+                    candidateList->candidate(index).select(ic_);
+                }
+            } else if (auto key = actionToKey(c)) {
+                testfrontend_->call<ITestFrontend::sendKeyEvent>(uuid_, *key,
+                                                                 false);
+            } else {
+                continue;
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed > budget_) {
+                FCITX_WARN()
+                    << "Event " << i << " (" << static_cast<int>(c)
+                    << ") took "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(
+                           elapsed)
+                           .count()
+                    << "ms, budget is " << budget_.count() << "ms";
+                result = false;
+            }
+        }
+        // Start every input from a clean state.
+        ic_->reset();
+        return result;
+    }
+
+private:
+    std::chrono::milliseconds budget_;
+    AddonInstance *testfrontend_ = nullptr;
+    ICUUID uuid_;
+    InputContext *ic_ = nullptr;
+};
+
+char arg0[] = "fuzzchewing";
+char arg1[] = "--disable=all";
+char arg2[] = "--enable=testim,testfrontend,chewing";
+char *instanceArgv[] = {arg0, arg1, arg2};
+
+} // namespace
+
+#ifdef ENABLE_FUZZER
+
+namespace {
+std::unique_ptr<Instance> fuzzInstance;
+std::unique_ptr<KeySequenceRunner> fuzzRunner;
+} // namespace
+
+extern "C" int LLVMFuzzerInitialize(int * /*argc*/, char *** /*argv*/) {
+    setupTestingEnvironment(TESTING_BINARY_DIR, {TESTING_BINARY_DIR "/src"},
+                            {TESTING_BINARY_DIR "/test"});
+    fuzzInstance = std::make_unique<Instance>(FCITX_ARRAY_SIZE(instanceArgv),
+                                              instanceArgv);
+    fuzzInstance->addonManager().registerDefaultLoader(nullptr);
+    fuzzInstance->initialize();
+    fuzzRunner = std::make_unique<KeySequenceRunner>(fuzzInstance.get());
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (!fuzzRunner->run(
+            std::string_view(reinterpret_cast<const char *>(data), size))) {
+        // Let libFuzzer record the input.
+        abort();
+    }
+    return 0;
+}
+
+#else
+
+int main(int argc, char *argv[]) {
+    setupTestingEnvironment(TESTING_BINARY_DIR, {TESTING_BINARY_DIR "/src"},
+                            {TESTING_BINARY_DIR "/test"});
+    std::vector<std::filesystem::path> corpus;
+    for (int i = 1; i < argc; i++) {
+        corpus.emplace_back(argv[i]);
+    }
+    if (corpus.empty()) {
+        corpus.emplace_back(TESTING_SOURCE_DIR "/test/fuzz-corpus");
+    }
+
+    Instance instance(FCITX_ARRAY_SIZE(instanceArgv), instanceArgv);
+    instance.addonManager().registerDefaultLoader(nullptr);
+    int ret = 0;
+    instance.eventDispatcher().schedule([&instance, &corpus, &ret]() {
+        KeySequenceRunner runner(&instance);
+        size_t slowInputs = 0;
+        for (const auto &dir : corpus) {
+            for (const auto &entry :
+                 std::filesystem::directory_iterator(dir)) {
+                if (!entry.is_regular_file()) {
+                    continue;
+                }
+                std::ifstream in(entry.path(), std::ios::binary);
+                std::string input{std::istreambuf_iterator<char>(in),
+                                  std::istreambuf_iterator<char>()};
+                FCITX_INFO() << "Replay " << entry.path().string();
+                if (!runner.run(input)) {
+                    slowInputs++;
+                }
+            }
+        }
+        if (slowInputs > 0 && explicitBudget()) {
+            FCITX_ERROR() << slowInputs << " inputs exceeded the budget";
+            ret = 1;
+        } else {
+            FCITX_INFO() << slowInputs << " inputs exceeded the budget";
+        }
+        instance.exit();
+    });
+    instance.exec();
+
+    return ret;
+}
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * SPDX-FileCopyrightText: 2026-2026 CSSlayer <wengxt@gmail.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ */
+// Replay a trace recorded with the RecordTrace option through the test
+// frontend, and compare the time spent on every event with the recording.
+//
+// Usage: replaychewing <trace file> [threshold in us]
+#include "testdir.h"
+#include "testfrontend_public.h"
+#include "trace.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/eventdispatcher.h>
+#include <fcitx-utils/key.h>
+#include <fcitx-utils/log.h>
+#include <fcitx-utils/macros.h>
+#include <fcitx-utils/testing.h>
+#include <fcitx/addonmanager.h>
+#include <fcitx/candidatelist.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputmethodgroup.h>
+#include <fcitx/inputmethodmanager.h>
+#include <fcitx/inputpanel.h>
+#include <fcitx/instance.h>
+#include <filesystem>
+#include <string>
+
+using namespace fcitx;
+
+namespace {
+
+const char *typeName(ChewingTraceRecordType type) {
+    switch (type) {
+    case ChewingTraceRecordType::Key:
+        return "Key";
+    case ChewingTraceRecordType::Select:
+        return "Select";
+    case ChewingTraceRecordType::Activate:
+        return "Activate";
+    case ChewingTraceRecordType::Deactivate:
+        return "Deactivate";
+    case ChewingTraceRecordType::Reset:
+        return "Reset";
+    case ChewingTraceRecordType::Config:
+        return "Config";
+    case ChewingTraceRecordType::Page:
+        return "Page";
+    case ChewingTraceRecordType::ForcedCommit:
+        return "ForcedCommit";
+    }
+    return "Unknown";
+}
+
+std::string argument(const ChewingTraceRecord &record) {
+    switch (record.type) {
+    case ChewingTraceRecordType::Key:
+        return record.key.toString();
+    case ChewingTraceRecordType::Activate:
+        return record.entry;
+    default:
+        return std::to_string(record.index);
+    }
+}
+
+void replay(Instance *instance, const std::filesystem::path &path,
+            std::chrono::microseconds threshold) {
+    ChewingTraceReader reader(path);
+    FCITX_ASSERT(reader.isValid()) << "Invalid trace file " << path.string();
+
+    auto *chewing = instance->addonManager().addon("chewing", true);
+    FCITX_ASSERT(chewing);
+    auto defaultGroup = instance->inputMethodManager().currentGroup();
+    defaultGroup.inputMethodList().clear();
+    defaultGroup.inputMethodList().push_back(
+        InputMethodGroupItem("keyboard-us"));
+    // The trace tells which of them is used.
+    for (const char *entry : {"chewing", "chewing-hsu", "chewing-pinyin"}) {
+        defaultGroup.inputMethodList().push_back(InputMethodGroupItem(entry));
+    }
+    defaultGroup.setDefaultInputMethod("");
+    instance->inputMethodManager().setGroup(defaultGroup);
+    auto *testfrontend = instance->addonManager().addon("testfrontend");
+    auto uuid =
+        testfrontend->call<ITestFrontend::createInputContext>("testapp");
+    auto *ic = instance->inputContextManager().findByUUID(uuid);
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("Control+space"), false));
+    FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+    size_t count = 0;
+    size_t slower = 0;
+    std::chrono::microseconds recordedTotal{0};
+    std::chrono::microseconds replayTotal{0};
+    while (auto record = reader.next()) {
+        auto start = std::chrono::steady_clock::now();
+        bool filtered = false;
+        switch (record->type) {
+        case ChewingTraceRecordType::Key:
+            filtered = testfrontend->call<ITestFrontend::sendKeyEvent>(
+                uuid, record->key, false);
+            break;
+        case ChewingTraceRecordType::Select:
+            if (auto candidateList = ic->inputPanel().candidateList();
+                candidateList && record->index < candidateList->size()) {
+                candidateList->candidate(record->index).select(ic);
+            }
+            break;
+        case ChewingTraceRecordType::Page:
+            if (auto candidateList = ic->inputPanel().candidateList();
+                candidateList && candidateList->toPageable()) {
+                if (record->index < 0) {
+                    candidateList->toPageable()->prev();
+                } else {
+                    candidateList->toPageable()->next();
+                }
+            }
+            break;
+        case ChewingTraceRecordType::Activate:
+            if (!record->entry.empty() &&
+                instance->inputMethod(ic) != record->entry) {
+                instance->setCurrentInputMethod(ic, record->entry, true);
+            }
+            ic->focusIn();
+            break;
+        case ChewingTraceRecordType::Deactivate:
+            ic->focusOut();
+            break;
+        case ChewingTraceRecordType::Reset:
+            ic->reset();
+            break;
+        case ChewingTraceRecordType::ForcedCommit:
+            // Follows the slow event, the replay commits only if it is slow
+            // as well.
+            FCITX_INFO() << record->timestamp.count()
+                         << "us preedit was committed by the watchdog";
+            continue;
+        case ChewingTraceRecordType::Config:
+            // Do not record the replay itself.
+            record->config.setValueByPath("RecordTrace", "False");
+            chewing->setConfig(record->config);
+            continue;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        count++;
+        recordedTotal += record->engineTime;
+        replayTotal += elapsed;
+        if (elapsed > record->engineTime * 2) {
+            slower++;
+        }
+        if (record->engineTime > threshold || elapsed > threshold) {
+            FCITX_INFO() << record->timestamp.count() << "us "
+                         << typeName(record->type) << " "
+                         << argument(*record)
+                         << ": recorded " << record->engineTime.count()
+                         << "us, replay " << elapsed.count() << "us";
+        }
+        if (record->type == ChewingTraceRecordType::Key &&
+            filtered != record->filtered) {
+            FCITX_WARN() << record->timestamp.count() << "us Key "
+                         << record->key.toString()
+                         << ": filtered state differs from the recording";
+        }
+    }
+    FCITX_INFO() << "Replayed " << count << " events, recorded "
+                 << recordedTotal.count() << "us, replay "
+                 << replayTotal.count() << "us, " << slower
+                 << " events more than 2x slower";
+    testfrontend->call<ITestFrontend::destroyInputContext>(uuid);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        FCITX_ERROR() << "Usage: " << argv[0]
+                      << " <trace file> [threshold in us]";
+        return 1;
+    }
+    const std::filesystem::path path = argv[1];
+    const std::chrono::microseconds threshold(argc > 2 ? atoi(argv[2])
+                                                       : 10000);
+    setupTestingEnvironment(TESTING_BINARY_DIR, {TESTING_BINARY_DIR "/src"},
+                            {TESTING_BINARY_DIR "/test"});
+    char arg0[] = "replaychewing";
+    char arg1[] = "--disable=all";
+    char arg2[] = "--enable=testim,testfrontend,chewing";
+    char *instanceArgv[] = {arg0, arg1, arg2};
+    Instance instance(FCITX_ARRAY_SIZE(instanceArgv), instanceArgv);
+    instance.addonManager().registerDefaultLoader(nullptr);
+    instance.eventDispatcher().schedule([&instance, &path, threshold]() {
+        replay(&instance, path, threshold);
+        instance.exit();
+    });
+    instance.exec();
+
+    return 0;
+}
@@ -6,23 +6,69 @@
  */
 #include "testdir.h"
 #include "testfrontend_public.h"
+#include "trace.h"
 #include <fcitx-config/rawconfig.h>
+#include <fcitx-utils/capabilityflags.h>
+#include <fcitx-utils/event.h>
 #include <fcitx-utils/eventdispatcher.h>
 #include <fcitx-utils/key.h>
 #include <fcitx-utils/keysym.h>
 #include <fcitx-utils/log.h>
 #include <fcitx-utils/macros.h>
+#include <fcitx-utils/standardpaths.h>
 #include <fcitx-utils/testing.h>
 #include <fcitx/addonmanager.h>
+#include <fcitx/event.h>
 #include <fcitx/inputmethodgroup.h>
 #include <fcitx/inputmethodmanager.h>
 #include <fcitx/inputpanel.h>
 #include <fcitx/instance.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <time.h>
+#include <vector>
 
 using namespace fcitx;
 
+namespace {
+
+// Searched for the dictionary before the system data directories, so
+// testReloadDictionary can replace the dictionary.
+constexpr char TestDataDir[] = TESTING_BINARY_DIR "/test/data";
+
+// Long enough for the reload delay of the engine and loading the dictionary.
+constexpr uint64_t DictionaryReloadWait = 3000000;
+
+std::vector<std::unique_ptr<EventSourceTime>> timers;
+
+// The preedit saved by testSaveComposition, restored by the next instance.
+std::string savedPreedit;
+
+void runLater(Instance *instance, uint64_t usec, std::function<void()> func) {
+    timers.push_back(instance->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + usec, 0,
+        [func = std::move(func)](EventSourceTime *, uint64_t) {
+            func();
+            return true;
+        }));
+}
+
+std::filesystem::path compositionFile() {
+    return StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+           "chewing" / "composition.bin";
+}
+
+} // namespace
+
 void testBasic(Instance *instance) {
     instance->eventDispatcher().schedule([instance]() {
         auto *chewing = instance->addonManager().addon("chewing", true);
@@ -282,26 +328,590 @@ void testCommitPreedit(Instance *instance) {
     });
 }
 
+void testIdleKeys(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        chewing->setConfig(config);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+        // Nothing is composed, these keys should reach the application.
+        FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Return"), false));
+        FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Left"), false));
+        FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Escape"), false));
+        // English typed with CapsLock.
+        FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key(FcitxKey_A, KeyState::CapsLock), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString().empty());
+
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString() == "ㄈ");
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Escape"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString().empty());
+        FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Return"), false));
+
+        instance->deactivate();
+    });
+}
+
+void testUnchangedPreedit(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        chewing->setConfig(config);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+        int preeditUpdates = 0;
+        auto watcher = instance->watchEvent(
+            EventType::InputContextUpdatePreedit, EventWatcherPhase::Default,
+            [&preeditUpdates](Event &) { preeditUpdates++; });
+        for (const char *key : {"z", "p", "space"}) {
+            FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+                uuid, Key(key), false));
+        }
+        FCITX_ASSERT(preeditUpdates == 3);
+        // Moves the cursor.
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Home"), false));
+        FCITX_ASSERT(preeditUpdates == 4);
+        // Handled by libchewing, but leaves the preedit as it is.
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Home"), false));
+        FCITX_ASSERT(preeditUpdates == 4);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Escape"), false));
+        FCITX_ASSERT(preeditUpdates == 5);
+
+        instance->deactivate();
+    });
+}
+
+void testReverseLookup(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        config.setValueByPath("ReverseLookup", "True");
+        chewing->setConfig(config);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("p"), false));
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("3"), false));
+        std::string text = ic->inputPanel().preedit().toString();
+        testfrontend->call<ITestFrontend::pushCommitExpectation>(text);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Return"), false));
+        FCITX_ASSERT(ic->inputPanel().auxDown().toString() ==
+                     text + ": ㄈㄣˇ");
+
+        // Reading is cleared once composing again.
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(ic->inputPanel().auxDown().toString().empty());
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Escape"), false));
+
+        config.setValueByPath("ReverseLookup", "False");
+        chewing->setConfig(config);
+        instance->deactivate();
+    });
+}
+
+void testLayoutEntries(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        chewing->setConfig(config);
+        auto defaultGroup = instance->inputMethodManager().currentGroup();
+        defaultGroup.inputMethodList().clear();
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("keyboard-us"));
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("chewing"));
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("chewing-pinyin"));
+        defaultGroup.setDefaultInputMethod("");
+        instance->inputMethodManager().setGroup(defaultGroup);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+
+        // The pinyin entry uses its own layout without changing the config.
+        instance->setCurrentInputMethod(ic, "chewing-pinyin", true);
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing-pinyin");
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString() != "ㄈ");
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Escape"), false));
+
+        instance->setCurrentInputMethod(ic, "chewing", true);
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString() == "ㄈ");
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Escape"), false));
+
+        instance->deactivate();
+    });
+}
+
+void testPrediction(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        config.setValueByPath("Prediction", "True");
+        chewing->setConfig(config);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+        auto commit = [testfrontend, ic, &uuid](const char *keys) {
+            for (const char *key = keys; *key; key++) {
+                FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+                    uuid, Key(std::string(1, *key)), false));
+            }
+            std::string text = ic->inputPanel().preedit().toString();
+            testfrontend->call<ITestFrontend::pushCommitExpectation>(text);
+            FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+                uuid, Key("Return"), false));
+            return text;
+        };
+        // ㄈㄣˇ, then ㄨˇ, then ㄈㄣˇ again predicts ㄨˇ.
+        auto first = commit("zp3");
+        auto second = commit("j3");
+        commit("zp3");
+        auto candidateList = ic->inputPanel().candidateList();
+        FCITX_ASSERT(candidateList && !candidateList->empty());
+        FCITX_ASSERT(candidateList->candidate(0).text().toString() == second);
+
+        // Selecting it commits and predicts the next one.
+        testfrontend->call<ITestFrontend::pushCommitExpectation>(second);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Alt+1"), false));
+        candidateList = ic->inputPanel().candidateList();
+        FCITX_ASSERT(candidateList && !candidateList->empty());
+        FCITX_ASSERT(candidateList->candidate(0).text().toString() == first);
+
+        // Escape only dismisses the prediction.
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Escape"), false));
+        FCITX_ASSERT(!ic->inputPanel().candidateList());
+
+        config.setValueByPath("Prediction", "False");
+        chewing->setConfig(config);
+        instance->deactivate();
+    });
+}
+
+void testPassthrough(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        chewing->setConfig(config);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+        // Keys of a password field go to the application untouched.
+        ic->setCapabilityFlags(CapabilityFlag::Password);
+        FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("p"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString().empty());
+
+        // A composition is dropped once the field becomes sensitive.
+        ic->setCapabilityFlags(CapabilityFlag::NoFlag);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString() == "ㄈ");
+        ic->setCapabilityFlags(CapabilityFlag::Sensitive);
+        FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("p"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString().empty());
+
+        ic->setCapabilityFlags(CapabilityFlag::NoFlag);
+        instance->deactivate();
+    });
+}
+
+void testSlowEvents(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        config.setValueByPath("SlowEventThreshold", "1");
+        config.setValueByPath("RecordTrace", "True");
+        chewing->setConfig(config);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+        // Make every key that changes the preedit slower than the threshold.
+        bool slow = true;
+        std::string preedit;
+        auto preeditWatcher = instance->watchEvent(
+            EventType::InputContextUpdatePreedit, EventWatcherPhase::Default,
+            [ic, &slow, &preedit](Event &) {
+                auto text = ic->inputPanel().preedit().toString();
+                if (!text.empty()) {
+                    preedit = text;
+                }
+                if (slow) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+            });
+        std::vector<std::string> commits;
+        auto commitWatcher = instance->watchEvent(
+            EventType::InputContextCommitString, EventWatcherPhase::Default,
+            [testfrontend, &commits](Event &event) {
+                auto &commitEvent = static_cast<CommitStringEvent &>(event);
+                commits.push_back(commitEvent.text());
+                testfrontend->call<ITestFrontend::pushCommitExpectation>(
+                    commitEvent.text());
+            });
+
+        // Three slow keys shorten the preedit, three more commit it.
+        for (const char *key : {"z", "p", "space", "z", "p"}) {
+            FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+                uuid, Key(key), false));
+        }
+        FCITX_ASSERT(commits.empty());
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("space"), false));
+        FCITX_ASSERT(commits.size() == 1);
+        FCITX_ASSERT(commits[0] == preedit);
+        FCITX_ASSERT(ic->inputPanel().preedit().toString().empty());
+
+        config.setValueByPath("RecordTrace", "False");
+        chewing->setConfig(config);
+        std::vector<std::filesystem::path> traces;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(
+                 StandardPaths::global().userDirectory(
+                     StandardPathsType::PkgData) /
+                     "chewing",
+                 ec)) {
+            const auto name = entry.path().filename().string();
+            if (name.starts_with("trace-") && name.ends_with(".bin")) {
+                traces.push_back(entry.path());
+            }
+        }
+        FCITX_ASSERT(!traces.empty());
+        ChewingTraceReader reader(std::ranges::max(traces));
+        FCITX_ASSERT(reader.isValid());
+        bool forcedCommit = false;
+        while (auto record = reader.next()) {
+            if (record->type == ChewingTraceRecordType::ForcedCommit) {
+                forcedCommit = true;
+            }
+        }
+        FCITX_ASSERT(forcedCommit);
+
+        // Fast keys step the degradation back, a slow key then keeps the
+        // bopomofo.
+        slow = false;
+        config.setValueByPath("SlowEventThreshold", "10000");
+        chewing->setConfig(config);
+        for (int i = 0; i < 400; i++) {
+            FCITX_ASSERT(!testfrontend->call<ITestFrontend::sendKeyEvent>(
+                uuid, Key("Left"), false));
+        }
+        slow = true;
+        config.setValueByPath("SlowEventThreshold", "1");
+        chewing->setConfig(config);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString() == "ㄈ");
+
+        slow = false;
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Escape"), false));
+        config.setValueByPath("SlowEventThreshold", "100");
+        chewing->setConfig(config);
+        instance->deactivate();
+    });
+}
+
+// Runs last in the first instance, since a later composition replaces the
+// saved one.
+void testSaveComposition(Instance *instance) {
+    auto *chewing = instance->addonManager().addon("chewing", true);
+    FCITX_ASSERT(chewing);
+    RawConfig config;
+    config.setValueByPath("Layout", "Default Keyboard");
+    chewing->setConfig(config);
+    auto *testfrontend = instance->addonManager().addon("testfrontend");
+
+    // The client commits its preedit on focus out, so it is not kept.
+    auto uuid =
+        testfrontend->call<ITestFrontend::createInputContext>("testapp");
+    auto *ic = instance->inputContextManager().findByUUID(uuid);
+    ic->setCapabilityFlags(CapabilityFlag::Preedit |
+                           CapabilityFlag::ClientUnfocusCommit);
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("Control+space"), false));
+    FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("z"), false));
+    chewing->save();
+    FCITX_ASSERT(std::filesystem::exists(compositionFile()));
+    ic->focusOut();
+    FCITX_ASSERT(!std::filesystem::exists(compositionFile()));
+    testfrontend->call<ITestFrontend::destroyInputContext>(uuid);
+
+    // A composition on the input panel is kept after the focus out reset.
+    uuid = testfrontend->call<ITestFrontend::createInputContext>("testapp");
+    ic = instance->inputContextManager().findByUUID(uuid);
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("Control+space"), false));
+    FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+    for (const char *key : {"z", "p", "space", "z"}) {
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key(key), false));
+    }
+    savedPreedit = ic->inputPanel().preedit().toString();
+    chewing->save();
+    FCITX_ASSERT(std::filesystem::exists(compositionFile()));
+    ic->focusOut();
+    FCITX_ASSERT(ic->inputPanel().preedit().toString().empty());
+    FCITX_ASSERT(std::filesystem::exists(compositionFile()));
+    testfrontend->call<ITestFrontend::destroyInputContext>(uuid);
+    instance->exit();
+}
+
+// Runs in a new instance, whose engine restores the composition saved by
+// the previous one.
+void testRestoreComposition(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        auto defaultGroup = instance->inputMethodManager().currentGroup();
+        defaultGroup.inputMethodList().clear();
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("keyboard-us"));
+        defaultGroup.inputMethodList().push_back(
+            InputMethodGroupItem("chewing"));
+        defaultGroup.setDefaultInputMethod("");
+        instance->inputMethodManager().setGroup(defaultGroup);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+        // The composition is replayed after the activation.
+        FCITX_ASSERT(ic->inputPanel().preedit().toString().empty());
+        runLater(instance, 100000, [instance, uuid]() {
+            auto *testfrontend =
+                instance->addonManager().addon("testfrontend");
+            auto *ic = instance->inputContextManager().findByUUID(uuid);
+            FCITX_ASSERT(!savedPreedit.empty());
+            FCITX_ASSERT(ic->inputPanel().preedit().toString() ==
+                         savedPreedit);
+            FCITX_ASSERT(!std::filesystem::exists(compositionFile()));
+            FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+                uuid, Key("Escape"), false));
+            instance->exit();
+        });
+    });
+}
+
+std::filesystem::path testDictionaryDir() {
+    return std::filesystem::path(TestDataDir) / "libchewing";
+}
+
+// A dictionary that fails to load keeps the old context.
+void testFailedDictionaryReload(Instance *instance, const ICUUID &uuid) {
+    auto *testfrontend = instance->addonManager().addon("testfrontend");
+    auto *ic = instance->inputContextManager().findByUUID(uuid);
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("z"), false));
+    FCITX_ASSERT(ic->inputPanel().preedit().toString() == "ㄈ");
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("Escape"), false));
+    testSaveComposition(instance);
+}
+
+// The reloaded dictionary is not used until the composition ends.
+void testDeferredDictionarySwap(Instance *instance, const ICUUID &uuid) {
+    auto *testfrontend = instance->addonManager().addon("testfrontend");
+    auto *ic = instance->inputContextManager().findByUUID(uuid);
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("p"), false));
+    FCITX_ASSERT(ic->inputPanel().preedit().toString() == "ㄈㄣ");
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("Escape"), false));
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("z"), false));
+    FCITX_ASSERT(ic->inputPanel().preedit().toString() == "ㄈ");
+    FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+        uuid, Key("Escape"), false));
+
+    std::ofstream(testDictionaryDir() / "tsi.dat", std::ios::trunc);
+    runLater(instance, DictionaryReloadWait, [instance, uuid]() {
+        testFailedDictionaryReload(instance, uuid);
+    });
+}
+
+// Runs last and ends with testSaveComposition, since it waits in the event
+// loop.
+void testReloadDictionary(Instance *instance) {
+    instance->eventDispatcher().schedule([instance]() {
+        std::filesystem::path systemDir;
+        for (const auto &file : StandardPaths::global().locateAll(
+                 StandardPathsType::Data, "libchewing/tsi.dat")) {
+            std::error_code ec;
+            if (!std::filesystem::equivalent(file.parent_path(),
+                                             testDictionaryDir(), ec)) {
+                systemDir = file.parent_path();
+                break;
+            }
+        }
+        if (systemDir.empty()) {
+            FCITX_INFO() << "No libchewing dictionary in data directories, "
+                            "skip dictionary reload test";
+            testSaveComposition(instance);
+            return;
+        }
+        auto *chewing = instance->addonManager().addon("chewing", true);
+        FCITX_ASSERT(chewing);
+        RawConfig config;
+        config.setValueByPath("Layout", "Default Keyboard");
+        chewing->setConfig(config);
+        auto *testfrontend = instance->addonManager().addon("testfrontend");
+        auto uuid =
+            testfrontend->call<ITestFrontend::createInputContext>("testapp");
+        auto *ic = instance->inputContextManager().findByUUID(uuid);
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("Control+space"), false));
+        FCITX_ASSERT(instance->inputMethod(ic) == "chewing");
+
+        FCITX_ASSERT(testfrontend->call<ITestFrontend::sendKeyEvent>(
+            uuid, Key("z"), false));
+        FCITX_ASSERT(ic->inputPanel().preedit().toString() == "ㄈ");
+        // libchewing loads the other data files from the same directory.
+        for (const auto &entry :
+             std::filesystem::directory_iterator(systemDir)) {
+            if (entry.is_regular_file()) {
+                std::filesystem::copy_file(
+                    entry.path(), testDictionaryDir() / entry.path().filename(),
+                    std::filesystem::copy_options::overwrite_existing);
+            }
+        }
+        runLater(instance, DictionaryReloadWait, [instance, uuid]() {
+            testDeferredDictionarySwap(instance, uuid);
+        });
+    });
+}
+
 int main() {
+    // Put the test data directory before the system ones, its libchewing
+    // directory has to exist when the engine starts to watch it.
+    std::filesystem::remove_all(TestDataDir);
+    std::filesystem::create_directories(testDictionaryDir());
+    const char *dataDirs = getenv("XDG_DATA_DIRS");
+    const std::string testDataDirs =
+        std::string(TestDataDir) + ":" +
+        (dataDirs && *dataDirs ? dataDirs : "/usr/local/share:/usr/share");
+    setenv("XDG_DATA_DIRS", testDataDirs.c_str(), 1);
     setupTestingEnvironment(TESTING_BINARY_DIR, {TESTING_BINARY_DIR "/src"},
                             {TESTING_BINARY_DIR "/test"});
+    std::filesystem::remove(compositionFile());
     // fcitx::Log::setLogRule("default=5,table=5,libime-table=5");
     char arg0[] = "testchewing";
     char arg1[] = "--disable=all";
     char arg2[] = "--enable=testim,testfrontend,chewing";
     char *argv[] = {arg0, arg1, arg2};
     fcitx::Log::setLogRule("default=5,chewing=5");
-    Instance instance(FCITX_ARRAY_SIZE(argv), argv);
-    instance.addonManager().registerDefaultLoader(nullptr);
+    {
+        Instance instance(FCITX_ARRAY_SIZE(argv), argv);
+        instance.addonManager().registerDefaultLoader(nullptr);
+
+        testBasic(&instance);
+        testBackspaceWhenBufferEmpty(&instance);
+        testBackspaceWithBuffer(&instance);
+        testBackspaceWithBopomofo(&instance);
+        testCommitPreedit(&instance);
+        testIdleKeys(&instance);
+        testUnchangedPreedit(&instance);
+        testReverseLookup(&instance);
+        testLayoutEntries(&instance);
+        testPrediction(&instance);
+        testPassthrough(&instance);
+        testSlowEvents(&instance);
+        testReloadDictionary(&instance);
+
+        instance.exec();
+        timers.clear();
+    }
+
+    // Restart with a new engine.
+    {
+        Instance instance(FCITX_ARRAY_SIZE(argv), argv);
+        instance.addonManager().registerDefaultLoader(nullptr);
 
-    testBasic(&instance);
-    testBackspaceWhenBufferEmpty(&instance);
-    testBackspaceWithBuffer(&instance);
-    testBackspaceWithBopomofo(&instance);
-    testCommitPreedit(&instance);
+        testRestoreComposition(&instance);
 
-    instance.eventDispatcher().schedule([&instance]() { instance.exit(); });
-    instance.exec();
+        instance.exec();
+        timers.clear();
+    }
 
     return 0;
 }